@@ -0,0 +1,165 @@
+/**
+ * @file    precision.cpp
+ * @ingroup Library
+ * @brief   Throughput and drift bias of the precision policies
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * Every policy runs the same constant-force problem, started far from the
+ * origin so that each step is small against the position:
+ *
+ *  - without noise, where the exact end position is known, giving the
+ *    relative error of the accumulated drift;
+ *  - with weak noise over a number of walkers, giving the throughput and
+ *    the bias of the mean displacement with its standard error.
+ *
+ * Usage: spbd-bench-precision [steps] [walkers]
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include "spbd.h"
+
+/* 1e-4 pN over a 200 nm grid, drifting 1e-6 nm per step from 100 nm */
+static langevin_configuration benchConfiguration(
+    float temperature
+    )
+{
+    langevin_configuration conf = langevin_configuration();
+    conf.saveFreq = 1;
+    conf.timestep = 0.1;
+    conf.temperature = temperature;
+    conf.damping = 10;
+    conf.positionStart = 100;
+    conf.positionSpacing = 0.01;
+    conf.forceVector.assign(20001, 1e-4);
+    conf.dampingVector.assign(20001, 1.0);
+    conf.seed = 1;
+    return conf;
+}
+
+struct bench_result {
+    double driftError;
+    double stepsPerSecond;
+    double bias;
+    double biasError;
+};
+
+template <class T>
+static const char *typeName()
+{
+    return sizeof(T) == sizeof(float) ? "float" : "double";
+}
+
+template <class Precision>
+static bench_result benchPrecision(
+    unsigned long long steps,
+    unsigned long long walkers
+    )
+{
+    typedef typename Precision::table_type table_type;
+
+    bench_result result;
+    langevin_observer none;
+
+    /* Noise-free drift against the exact displacement */
+    langevin_configuration conf = benchConfiguration(0.0);
+    double expected = steps*((double)conf.forceVector[0]*conf.timestep
+                             /((double)conf.damping*conf.dampingVector[0]));
+
+    langevin_tables_of<table_type> tables;
+    buildLangevinTables(conf, tables);
+    langevin_walker_of<Precision> walker;
+    seedLangevinWalker(walker, conf.positionStart, conf.seed, 0);
+    advanceLangevinWalker(tables, walker, 0, 1, steps, conf.saveFreq, none);
+    result.driftError =
+        ((double)walker.position - conf.positionStart)/expected - 1.0;
+
+    /* Weak noise, mean displacement over the walkers */
+    conf = benchConfiguration(1e-6);
+    buildLangevinTables(conf, tables);
+
+    double sum = 0.0;
+    double squares = 0.0;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (unsigned long long w = 0; w < walkers; w++) {
+        seedLangevinWalker(walker, conf.positionStart, conf.seed, w);
+        advanceLangevinWalker(tables, walker, w, 1, steps, conf.saveFreq, none);
+        double displacement = (double)walker.position - conf.positionStart;
+        sum += displacement;
+        squares += displacement*displacement;
+    }
+    result.stepsPerSecond = walkers*steps/langevinElapsed(start);
+
+    double mean = sum/walkers;
+    double variance = squares/walkers - mean*mean;
+    result.bias = mean - expected;
+    result.biasError = std::sqrt((variance > 0.0 ? variance : 0.0)/(walkers-1));
+    return result;
+}
+
+template <class Precision>
+static void reportPrecision(
+    int precision,
+    unsigned long long steps,
+    unsigned long long walkers
+    )
+{
+    bench_result result = benchPrecision<Precision>(steps, walkers);
+    std::cout << std::left
+              << std::setw(13) << langevinPrecisionString(precision)
+              << std::setw(8) << typeName<typename Precision::table_type>()
+              << std::setw(8) << typeName<typename Precision::noise_type>()
+              << std::setw(8) << typeName<typename Precision::position_type>()
+              << (Precision::compensated ? "kahan  " : "plain  ")
+              << std::right << std::setprecision(3)
+              << std::setw(11) << result.stepsPerSecond
+              << std::setw(13) << result.driftError
+              << std::setw(12) << result.bias
+              << std::setw(11) << result.biasError
+              << "\n";
+}
+
+int main(
+         int argc,
+         char **argv
+         )
+{
+    unsigned long long steps = argc > 1 ? std::strtoull(argv[1], NULL, 10) : 10000000;
+    unsigned long long walkers = argc > 2 ? std::strtoull(argv[2], NULL, 10) : 8;
+    if (steps == 0 || walkers < 2) {
+        std::cout << "Usage: spbd-bench-precision [steps] [walkers >= 2]\n";
+        return 1;
+    }
+
+    std::cout << "Precision policies, " << steps << " steps, " << walkers
+              << " walkers, drift " << 1e-6*steps << " nm from 100 nm.\n"
+              << "drift error: relative error of the noise-free drift\n"
+              << "bias: mean displacement minus drift with noise [nm]\n\n";
+    std::cout << "precision    tables  noise   position sum    "
+              << "  steps/s  drift error   bias [nm]   +/- [nm]\n";
+    reportPrecision<langevin_precision_float>(
+        SPBD_PRECISION_FLOAT, steps, walkers);
+    reportPrecision<langevin_precision_mixed>(
+        SPBD_PRECISION_MIXED, steps, walkers);
+    reportPrecision<langevin_precision_compensated>(
+        SPBD_PRECISION_COMPENSATED, steps, walkers);
+    reportPrecision<langevin_precision_double>(
+        SPBD_PRECISION_DOUBLE, steps, walkers);
+    std::cout << std::endl;
+
+    return 0;
+}
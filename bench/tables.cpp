@@ -0,0 +1,157 @@
+/**
+ * @file    tables.cpp
+ * @ingroup Library
+ * @brief   Throughput of float and compact tables against the grid size
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * A harmonic well spanning 10 nm is sampled on grids of increasing size.
+ * On the finest grids every step jumps thousands of grid points, so each
+ * lookup is a cache miss once the tables outgrow the last-level cache.
+ * The report gives the table size of each layout, the throughput of the
+ * mixed (float tables, double position) and compact (fp16 tables, double
+ * position) policies, and the largest encoding error of the compact
+ * tables relative to the largest step of each table.
+ *
+ * Usage: spbd-bench-tables [steps] [largest grid size]
+ *
+ * Build with -DSPBD_NO_PREFETCH to measure without software prefetch.
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+#include "spbd.h"
+
+/* Harmonic well over [0, 10] nm, its standard deviation a sixth of that */
+static langevin_configuration benchConfiguration(
+    unsigned long points
+    )
+{
+    const double length = 10.0;
+    langevin_configuration conf = langevin_configuration();
+    conf.saveFreq = 1;
+    conf.timestep = 0.1;
+    conf.temperature = 0.025;
+    conf.damping = 10;
+    conf.positionStart = length/2;
+    conf.positionSpacing = length/(points-1);
+    conf.seed = 1;
+
+    double stiffness = conf.temperature*36/(length*length);
+    conf.forceVector.resize(points);
+    conf.dampingVector.assign(points, 1.0);
+    for (unsigned long i = 0; i < points; i++) {
+        conf.forceVector[i] = -stiffness*(i*conf.positionSpacing - length/2);
+    }
+    return conf;
+}
+
+/* Walker steps per second of one walker on tables, best of three runs */
+template <class Precision>
+static double benchSteps(
+    langevin_configuration const &conf,
+    langevin_tables_of<typename Precision::table_type> const &tables,
+    unsigned long long steps
+    )
+{
+    langevin_observer none;
+    langevin_walker_of<Precision> walker;
+    seedLangevinWalker(walker, conf.positionStart, conf.seed, 0);
+
+    // Warm up, so the first pass over the tables is not timed
+    advanceLangevinWalker(tables, walker, 0, 1, steps/10 + 1,
+                          conf.saveFreq, none);
+    double best = 0.0;
+    for (int run = 0; run < 3; run++) {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        advanceLangevinWalker(tables, walker, 0, 1, steps, conf.saveFreq, none);
+        best = std::max(best, steps/langevinElapsed(start));
+    }
+    return best;
+}
+
+/* Largest decoding error of a compact table over its largest step */
+static double compactError(
+    langevin_tables const &tables,
+    langevin_compact_tables const &compact
+    )
+{
+    double externalLargest = 0.0;
+    double externalError = 0.0;
+    double thermalLargest = 0.0;
+    double thermalError = 0.0;
+    for (unsigned long i = 0; i < tables.bins(); i++) {
+        float external;
+        float thermal;
+        langevinSteps(compact, i, external, thermal);
+        externalLargest = std::max(externalLargest,
+                                   (double)std::fabs(tables.external[i]));
+        externalError = std::max(externalError,
+                                 (double)std::fabs(external - tables.external[i]));
+        thermalLargest = std::max(thermalLargest,
+                                  (double)std::fabs(tables.thermal[i]));
+        thermalError = std::max(thermalError,
+                                (double)std::fabs(thermal - tables.thermal[i]));
+    }
+    return std::max(
+        externalLargest > 0.0 ? externalError/externalLargest : 0.0,
+        thermalLargest > 0.0 ? thermalError/thermalLargest : 0.0);
+}
+
+int main(
+         int argc,
+         char **argv
+         )
+{
+    unsigned long long steps = argc > 1 ? std::strtoull(argv[1], NULL, 10) : 10000000;
+    unsigned long largestGrid = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 10000000;
+    if (steps == 0 || largestGrid < 1000) {
+        std::cout << "Usage: spbd-bench-tables [steps] [largest grid size >= 1000]\n";
+        return 1;
+    }
+
+    std::cout << "Table layouts, harmonic well over 10 nm, " << steps
+              << " steps per run.\n"
+              << "float tables: two float arrays; compact: interleaved fp16\n\n";
+    std::cout << "   grid points  float [MB]  compact [MB]  mixed steps/s"
+              << "  compact steps/s  speedup  max error\n";
+
+    for (unsigned long points = 1000; points <= largestGrid; points *= 10) {
+        langevin_configuration conf = benchConfiguration(points);
+        langevin_tables tables;
+        buildLangevinTables(conf, tables);
+        langevin_compact_tables compact;
+        buildLangevinTables(conf, compact);
+
+        double mixed = benchSteps<langevin_precision_mixed>(conf, tables, steps);
+        double fast = benchSteps<langevin_precision_compact>(conf, compact, steps);
+
+        std::cout << std::setw(14) << points << std::fixed << std::setprecision(2)
+                  << std::setw(12) << 2.0*points*sizeof(float)/1048576
+                  << std::setw(14) << points*sizeof(langevin_half_step)/1048576.0
+                  << std::scientific << std::setprecision(3)
+                  << std::setw(15) << mixed
+                  << std::setw(17) << fast
+                  << std::fixed << std::setprecision(2)
+                  << std::setw(9) << fast/mixed
+                  << std::scientific << std::setprecision(1)
+                  << std::setw(11) << compactError(tables, compact)
+                  << "\n" << std::flush;
+    }
+    std::cout << std::endl;
+
+    return 0;
+}
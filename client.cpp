@@ -0,0 +1,124 @@
+/**
+ * @file    client.cpp
+ * @ingroup Server
+ * @brief   Local client submitting configuration files to a job server
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int sendAll(
+    int fd,
+    std::string const &text
+    )
+{
+    size_t sent = 0;
+    while (sent < text.size()) {
+        ssize_t n = send(fd, text.data() + sent, text.size() - sent,
+                         MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        sent += n;
+    }
+    return 0;
+}
+
+int main(
+         int argc,
+         char **argv
+         )
+{
+    char usage[] = {"\n\
+    Usage:\n\n\
+        spbd-client [--quit] <socket> [spbd.in ...]\n\n\
+    Submits every spbd.in as a job to the server listening on <socket>\n\
+    and prints the results as they arrive. --quit stops the server once\n\
+    the jobs are done.\n\n"};
+
+    bool quit = false;
+    int first = 1;
+    if (argc > 1 && std::strcmp(argv[1], "--quit") == 0) {
+        quit = true;
+        first = 2;
+    }
+    if (argc <= first) {
+        std::cout << usage;
+        return 1;
+    }
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (std::strlen(argv[first]) >= sizeof(address.sun_path)) {
+        std::cout << "Socket path too long: " << argv[first] << "\n";
+        return 1;
+    }
+    std::strcpy(address.sun_path, argv[first]);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        std::cout << "Could not connect to " << argv[first] << ": "
+                  << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    /* Send every configuration file as a job, named after the file */
+    for (int i = first+1; i < argc; i++) {
+        std::ifstream infile(argv[i]);
+        if (!infile) {
+            std::cout << "Could not open " << argv[i] << "\n";
+            continue;
+        }
+        std::ostringstream job;
+        job << "job " << argv[i] << "\n" << infile.rdbuf() << "\nend\n";
+        if (sendAll(fd, job.str()) != 0) {
+            std::cout << "Could not send " << argv[i] << "\n";
+            close(fd);
+            return 1;
+        }
+    }
+    if (quit) {
+        sendAll(fd, "quit\n");
+    }
+    // The server closes the connection after the last result
+    shutdown(fd, SHUT_WR);
+
+    char buffer[65536];
+    while (true) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        std::cout.write(buffer, n);
+    }
+    std::cout << std::flush;
+    close(fd);
+
+    return 0;
+}
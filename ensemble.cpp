@@ -0,0 +1,455 @@
+/**
+ * @file    ensemble.cpp
+ * @ingroup Ensemble
+ * @brief   Routines for computing walker ensembles
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <new>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ensemble.h"
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+#error "Shared-memory ensembles need lock-free 64-bit atomics"
+#endif
+
+/* Merge state of a worker, kept in shared memory */
+enum {
+    WORKER_RUNNING = 0,
+    WORKER_MERGING = 1,
+    WORKER_DONE    = 2
+};
+
+/* Layout of the shared segment: header, histograms, worker records */
+struct ensemble_shared_header {
+    std::atomic<unsigned long long> samples;
+    std::atomic<unsigned long long> batches;
+    std::atomic<unsigned long long> batchSamples;
+    std::atomic<unsigned long long> walkerSteps;
+    std::atomic<unsigned long long> events;
+    std::atomic<unsigned long long> eventSteps;
+    std::atomic<double> eventStepSquares;
+    std::atomic<int> stopReason;
+    /* Blocks merged by all workers together, and blocks decided on */
+    std::atomic<unsigned long long> arrivals;
+    std::atomic<unsigned long long> blocksDecided;
+    /* Set when a worker is lost for good, releases the waiting workers */
+    std::atomic<int> failed;
+};
+
+struct ensemble_shared_worker {
+    std::atomic<int> state;
+    std::atomic<unsigned long long> blocksMerged;
+};
+
+/* Pointers into the mapped segment */
+struct ensemble_shared {
+    ensemble_shared_header *header;
+    std::atomic<unsigned long long> *histogram;
+    std::atomic<unsigned long long> *histogramSquares;
+    /* Counts of the current block over all workers, squared once complete */
+    std::atomic<unsigned long long> *blockHistogram;
+    ensemble_shared_worker *workers;
+    unsigned long bins;
+};
+
+static void addShared(
+    std::atomic<double> &target,
+    double value
+    )
+{
+    double old = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(old, old + value,
+                                         std::memory_order_relaxed)) {
+    }
+}
+
+/* Adds a block of one worker, its squares only make sense for all workers */
+static void mergeEnsembleShared(
+    langevin_ensemble_output const &local,
+    ensemble_shared &shared
+    )
+{
+    for (unsigned long i = 0; i < local.histogram.size(); i++) {
+        if (local.histogram[i] != 0) {
+            shared.histogram[i].fetch_add(local.histogram[i],
+                                          std::memory_order_relaxed);
+            shared.blockHistogram[i].fetch_add(local.histogram[i],
+                                               std::memory_order_relaxed);
+        }
+    }
+    ensemble_shared_header *header = shared.header;
+    header->samples.fetch_add(local.samples, std::memory_order_relaxed);
+    header->batchSamples.fetch_add(local.batchSamples, std::memory_order_relaxed);
+    header->walkerSteps.fetch_add(local.walkerSteps, std::memory_order_relaxed);
+    header->events.fetch_add(local.events, std::memory_order_relaxed);
+    header->eventSteps.fetch_add(local.eventSteps, std::memory_order_relaxed);
+    addShared(header->eventStepSquares, local.eventStepSquares);
+}
+
+/* Ends a block all workers merged, adding it as a batch if counted */
+static void closeEnsembleBlockShared(
+    bool counted,
+    ensemble_shared &shared
+    )
+{
+    for (unsigned long i = 0; i < shared.bins; i++) {
+        unsigned long long count =
+            shared.blockHistogram[i].exchange(0, std::memory_order_relaxed);
+        if (counted) {
+            shared.histogramSquares[i].fetch_add(count*count,
+                                                 std::memory_order_relaxed);
+        }
+    }
+    if (counted) {
+        shared.header->batches.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/* Copies the shared accumulators, the histograms only if with histograms */
+static void loadEnsembleShared(
+    ensemble_shared const &shared,
+    bool histograms,
+    langevin_ensemble_output &ensemble
+    )
+{
+    ensemble = langevin_ensemble_output();
+    if (histograms) {
+        ensemble.histogram.resize(shared.bins);
+        ensemble.histogramSquares.resize(shared.bins);
+        for (unsigned long i = 0; i < shared.bins; i++) {
+            ensemble.histogram[i] = shared.histogram[i].load();
+            ensemble.histogramSquares[i] = shared.histogramSquares[i].load();
+        }
+    }
+    ensemble.samples = shared.header->samples.load();
+    ensemble.batches = shared.header->batches.load();
+    ensemble.batchSamples = shared.header->batchSamples.load();
+    ensemble.walkerSteps = shared.header->walkerSteps.load();
+    ensemble.events = shared.header->events.load();
+    ensemble.eventSteps = shared.header->eventSteps.load();
+    ensemble.eventStepSquares = shared.header->eventStepSquares.load();
+}
+
+/*
+ * Block control of one worker: merges every new block into the segment
+ * and waits until every worker has merged the block. The last one to
+ * arrive adds the block as a batch, checks the stopping criteria on the
+ * totals of that block and publishes the decision, so all workers stop
+ * after the same block, the one a single process would stop after.
+ * Blocks a failed worker already merged are skipped when it is restarted.
+ */
+struct ensemble_shared_control {
+    langevin_configuration const &conf;
+    ensemble_shared &shared;
+    ensemble_shared_worker &worker;
+    std::chrono::steady_clock::time_point start;
+
+    int onBlock(unsigned long long index, langevin_ensemble_output const &block)
+    {
+        ensemble_shared_header *header = shared.header;
+        if (index >= worker.blocksMerged.load(std::memory_order_acquire)) {
+            worker.state.store(WORKER_MERGING, std::memory_order_release);
+            mergeEnsembleShared(block, shared);
+            unsigned long long arrived =
+                header->arrivals.fetch_add(1, std::memory_order_acq_rel) + 1;
+            if (arrived == conf.processes*(index+1)) {
+                decide(index, block.batches > 0);
+            }
+            worker.blocksMerged.store(index+1, std::memory_order_release);
+            worker.state.store(WORKER_RUNNING, std::memory_order_release);
+        }
+
+        while (header->blocksDecided.load(std::memory_order_acquire) <= index) {
+            if (header->failed.load(std::memory_order_acquire)) {
+                return SPBD_STOP_STEPS;
+            }
+            std::this_thread::yield();
+        }
+        // Only the last decided block can carry a stop
+        if (header->blocksDecided.load(std::memory_order_acquire) > index+1) {
+            return SPBD_RUNNING;
+        }
+        return header->stopReason.load(std::memory_order_acquire);
+    }
+
+    void decide(unsigned long long index, bool counted)
+    {
+        closeEnsembleBlockShared(counted, shared);
+        langevin_ensemble_output total;
+        loadEnsembleShared(shared, conf.targetRelativeError > 0.0, total);
+        int reason = checkLangevinConvergence(conf, total, langevinElapsed(start));
+        if (reason != SPBD_RUNNING) {
+            shared.header->stopReason.store(reason, std::memory_order_release);
+        }
+        shared.header->blocksDecided.store(index+1, std::memory_order_release);
+    }
+};
+
+int computeLangevinEnsemble(
+    langevin_simulation &simu
+    )
+{
+    if (simu.conf.processes > 1) {
+        return computeLangevinEnsembleShared(simu);
+    }
+
+    std::cout << "Running " << simu.conf.walkers << " walkers for "
+              << simu.conf.steps << " steps... " << std::flush;
+    int status = simulateLangevinEnsemble(simu.conf, simu.ensemble);
+    if (status != SPBD_SUCCESS) {
+        std::cout << langevinErrorString(status) << ".\n";
+        return status;
+    }
+    std::cout << "done.\n" << std::endl;
+
+    return 0;
+}
+
+/* Forks a worker computing the walkers of shard p, returns its pid */
+template <class Precision>
+static pid_t forkEnsembleWorker(
+    langevin_configuration const &conf,
+    langevin_tables_of<typename Precision::table_type> const &tables,
+    ensemble_shared &shared,
+    std::chrono::steady_clock::time_point start,
+    unsigned long long p
+    )
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        ensemble_shared_control control = {conf, shared, shared.workers[p], start};
+        runLangevinEnsemble<Precision>(conf, tables,
+            conf.walkers*p/conf.processes, conf.walkers*(p+1)/conf.processes,
+            control);
+        shared.workers[p].state.store(WORKER_DONE, std::memory_order_release);
+        // Skip atexit handlers and stream flushes inherited from the parent
+        _exit(0);
+    }
+    return pid;
+}
+
+/* Runs the shared ensemble with the tables and walkers of a policy */
+template <class Precision>
+static int runEnsembleShared(
+    langevin_simulation &simu
+    )
+{
+    const unsigned long long processes = simu.conf.processes;
+    const unsigned long bins = simu.conf.forceVector.size();
+
+    std::cout << "  Pre-computing force step sizes... ";
+    langevin_tables_of<typename Precision::table_type> tables;
+    buildLangevinTables(simu.conf, tables);
+    std::cout << "done.\n";
+
+    /* Create the shared segment */
+    std::cout << "  Creating shared memory segment... ";
+    size_t histogramOffset = sizeof(ensemble_shared_header);
+    size_t squaresOffset = histogramOffset
+        + bins*sizeof(std::atomic<unsigned long long>);
+    size_t blockOffset = squaresOffset
+        + bins*sizeof(std::atomic<unsigned long long>);
+    size_t workerOffset = blockOffset
+        + bins*sizeof(std::atomic<unsigned long long>);
+    size_t segmentSize = workerOffset
+        + processes*sizeof(ensemble_shared_worker);
+
+    std::ostringstream name;
+    name << "/spbd-ensemble-" << getpid();
+    int fd = shm_open(name.str().c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        std::cout << "failed.\n";
+        return -1;
+    }
+    // The segment stays alive for as long as it is mapped
+    shm_unlink(name.str().c_str());
+    if (ftruncate(fd, segmentSize) != 0) {
+        std::cout << "failed.\n";
+        close(fd);
+        return -1;
+    }
+    void *segment = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED) {
+        std::cout << "failed.\n";
+        return -1;
+    }
+
+    char *base = static_cast<char*>(segment);
+    ensemble_shared shared;
+    shared.bins = bins;
+    shared.header = new (base) ensemble_shared_header();
+    shared.histogram = reinterpret_cast<std::atomic<unsigned long long>*>(
+        base + histogramOffset);
+    shared.histogramSquares = reinterpret_cast<std::atomic<unsigned long long>*>(
+        base + squaresOffset);
+    shared.blockHistogram = reinterpret_cast<std::atomic<unsigned long long>*>(
+        base + blockOffset);
+    shared.workers = reinterpret_cast<ensemble_shared_worker*>(
+        base + workerOffset);
+
+    ensemble_shared_header *header = shared.header;
+    header->samples.store(0);
+    header->batches.store(0);
+    header->batchSamples.store(0);
+    header->walkerSteps.store(0);
+    header->events.store(0);
+    header->eventSteps.store(0);
+    header->eventStepSquares.store(0.0);
+    header->stopReason.store(SPBD_RUNNING);
+    header->arrivals.store(0);
+    header->blocksDecided.store(0);
+    header->failed.store(0);
+    if (!header->eventStepSquares.is_lock_free()) {
+        std::cout << "failed, no lock-free double atomics.\n";
+        munmap(segment, segmentSize);
+        return -1;
+    }
+    for (unsigned long i = 0; i < bins; i++) {
+        new (&shared.histogram[i]) std::atomic<unsigned long long>(0);
+        new (&shared.histogramSquares[i]) std::atomic<unsigned long long>(0);
+        new (&shared.blockHistogram[i]) std::atomic<unsigned long long>(0);
+    }
+    for (unsigned long long p = 0; p < processes; p++) {
+        ensemble_shared_worker *worker =
+            new (&shared.workers[p]) ensemble_shared_worker();
+        worker->state.store(WORKER_RUNNING);
+        worker->blocksMerged.store(0);
+    }
+    std::cout << "done.\n";
+
+    /* Fork the workers */
+    std::cout << "Running " << simu.conf.walkers << " walkers for "
+              << simu.conf.steps << " steps on " << processes
+              << " processes... " << std::flush;
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::vector<pid_t> pids(processes, -1);
+    for (unsigned long long p = 0; p < processes; p++) {
+        pids[p] = forkEnsembleWorker<Precision>(simu.conf, tables, shared,
+                                                start, p);
+    }
+
+    /*
+     * Collect the workers in the order they end, since the others wait on
+     * the blocks of a failed one. A worker that failed while running is
+     * restarted once and skips the blocks it already merged.
+     */
+    int result = 0;
+    std::vector<bool> restarted(processes, false);
+    std::vector<bool> collected(processes, false);
+    unsigned long long remaining = processes;
+    while (remaining > 0) {
+        // A worker that could not be forked has failed already
+        unsigned long long p = 0;
+        while (p < processes && (collected[p] || pids[p] > 0)) {
+            p++;
+        }
+        if (p == processes) {
+            int exitStatus = 0;
+            pid_t pid = waitpid(-1, &exitStatus, 0);
+            if (pid < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                result = -1;
+                break;
+            }
+            for (p = 0; p < processes && pids[p] != pid; p++) {
+            }
+            if (p == processes) {
+                continue;
+            }
+            pids[p] = 0;
+        }
+
+        int workerState = shared.workers[p].state.load(std::memory_order_acquire);
+        if (workerState == WORKER_DONE) {
+            collected[p] = true;
+            remaining--;
+            continue;
+        }
+        if (workerState == WORKER_RUNNING && !restarted[p]) {
+            std::cout << "\n  Worker " << p << " failed after "
+                      << shared.workers[p].blocksMerged.load()
+                      << " blocks, restarting it... " << std::flush;
+            restarted[p] = true;
+            pids[p] = forkEnsembleWorker<Precision>(simu.conf, tables, shared,
+                                                    start, p);
+            continue;
+        }
+        if (workerState == WORKER_MERGING) {
+            std::cout << "\n  Worker " << p << " failed while merging results.";
+        } else {
+            std::cout << "\n  Worker " << p << " failed again.";
+        }
+        // Let the other workers finish instead of waiting for its blocks
+        header->failed.store(1, std::memory_order_release);
+        collected[p] = true;
+        remaining--;
+        result = -1;
+    }
+
+    /* Copy the aggregated results out of the segment */
+    loadEnsembleShared(shared, true, simu.ensemble);
+    simu.ensemble.stopReason = header->stopReason.load();
+    if (simu.ensemble.stopReason == SPBD_RUNNING) {
+        simu.ensemble.stopReason = SPBD_STOP_STEPS;
+    }
+
+    munmap(segment, segmentSize);
+
+    std::cout << (result == 0 ? "done.\n" : " failed.\n") << std::endl;
+    return result;
+}
+
+struct ensemble_shared_runner {
+    langevin_simulation &simu;
+
+    template <class Precision>
+    int run()
+    {
+        return runEnsembleShared<Precision>(simu);
+    }
+};
+
+int computeLangevinEnsembleShared(
+    langevin_simulation &simu
+    )
+{
+    std::cout << "Initializing shared ensemble.\n";
+
+    int status = validateLangevinConfiguration(simu.conf);
+    if (status != SPBD_SUCCESS) {
+        std::cout << "  " << langevinErrorString(status) << ".\n";
+        return status;
+    }
+
+    ensemble_shared_runner runner = {simu};
+    return dispatchLangevinPrecision(simu.conf.precision, runner);
+}
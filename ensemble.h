@@ -0,0 +1,64 @@
+/**
+ * @defgroup  Ensemble  Ensemble routines
+ * @brief     Multi-walker Langevin ensembles, optionally sharded over
+ *            worker processes
+*/
+/**
+ * @file    ensemble.h
+ * @ingroup Ensemble
+ * @brief   Contains declarations for the walker ensemble routines
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#ifndef _LANGEVINENSEMBLE_H_
+#define _LANGEVINENSEMBLE_H_
+
+#include <vector>
+
+#include "langevin.h"
+
+/**
+ * @brief   Computes an ensemble of independent walkers
+ * @ingroup Ensemble
+ * @author  Kherim Willems
+ * @param   simu     Simulation object, results are stored in simu.ensemble
+ * @returns 0 on success
+ *
+ * Runs conf.walkers walkers of conf.steps steps each. Every walker draws
+ * from its own random stream, seeded from conf.seed and the walker index,
+ * so the result does not depend on conf.processes. With conf.processes > 1
+ * the walkers are split over forked worker processes sharing a single
+ * POSIX shared-memory segment.
+ */
+int computeLangevinEnsemble(
+    langevin_simulation &simu
+    );
+
+/**
+ * @brief   Computes an ensemble over forked worker processes
+ * @ingroup Ensemble
+ * @author  Kherim Willems
+ * @param   simu     Simulation object, results are stored in simu.ensemble
+ * @returns 0 on success, -1 if the results could not be recovered
+ *
+ * Workers merge their histogram and event counts into shared accumulators
+ * with atomic adds and wait for each other at the end of every block, so
+ * the stopping criteria are checked on the same totals, and the run stops
+ * after the same block, as with a single process. A worker that dies
+ * outside a merge is restarted once and skips the blocks it merged.
+ */
+int computeLangevinEnsembleShared(
+    langevin_simulation &simu
+    );
+
+#endif
@@ -32,6 +32,11 @@ int readFileToStrings(
     {
         // Opening the file for reading
         infile.open(filename.c_str(), std::ios::in);
+        if (!infile.is_open())
+        {
+            std::cout << "Cannot open file: " << filename << std::endl;
+            return -1;
+        }
         
         // Read all the lines
         while (std::getline(infile, line))
@@ -41,7 +46,7 @@ int readFileToStrings(
         
         infile.close();
     }
-    catch (std::exception e)
+    catch (std::exception const &e)
     {
         std::cout << "Exception opening file: " << filename << "\n"
                   << "Exception: " << e.what() << std::endl;
@@ -57,44 +62,208 @@ void writeSimulationResultsToFile(
     writeTrajectoryToFile(
         simu.conf.trajectoryOutputFile,
         simu.out.positionVector,
-        simu.out.timeVector);
+        simu.out.timeVector,
+        langevinPositionDigits(simu.conf.precision));
 }
 
 void writeTrajectoryToFile(
     std::string const &filename,
-    std::vector<float> const &positionVector,
-    std::vector<unsigned long long> const &timeVector
+    std::vector<double> const &positionVector,
+    std::vector<unsigned long long> const &timeVector,
+    int digits
     )
 {
     // Allocate variables
     std::ofstream outfile;
+    
+    try
+    {
+        // Open file for writing
+        outfile.open(filename.c_str(), std::ios::out | std::ios::trunc);
+        writeTrajectory(outfile, positionVector, timeVector, digits);
+        outfile.close();
+    }
+    catch (std::exception const &e)
+    {
+        std::cout << "Exception writing to file: " << filename << "\n"
+                  << "Exception: " << e.what() << std::endl;
+    }
+}
+
+void writeTrajectory(
+    std::ostream &out,
+    std::vector<double> const &positionVector,
+    std::vector<unsigned long long> const &timeVector,
+    int digits
+    )
+{
     unsigned long long step;
-    float position;
+    double position;
+    std::streamsize precision = out.precision(digits);
+    
+    // Print out header
+    out << "step" << ", " << "position" << "\n";
+    // Print out all values
+    for (unsigned long long i = 0; i < timeVector.size(); i++)
+    {
+        // Load step number and postion
+        step = timeVector[i];
+        position = positionVector[i];
+        // Save data
+        out << step << ", " << position << "\n";
+    }
+    out.precision(precision);
+}
+
+void writeEnsembleResultsToFile(
+    langevin_simulation const &simu
+    )
+{
+    if (!simu.conf.histogramOutputFile.empty())
+    {
+        writeHistogramToFile(
+            simu.conf.histogramOutputFile,
+            simu.conf.positionSpacing,
+            simu.ensemble);
+    }
+    if (!simu.conf.eventOutputFile.empty())
+    {
+        writeEventsToFile(
+            simu.conf.eventOutputFile,
+            simu.conf.timestep,
+            simu.conf.walkers,
+            simu.ensemble);
+    }
+}
+
+void writeHistogramToFile(
+    std::string const &filename,
+    float positionSpacing,
+    std::vector<unsigned long long> const &histogram
+    )
+{
+    // Allocate variables
+    std::ofstream outfile;
     
     try
     {
         // Open file for writing
         outfile.open(filename.c_str(), std::ios::out | std::ios::trunc);
-        // Print out header
-        outfile << "step" << ", " << "position" << "\n";
-        // Print out all values to file
-        for (unsigned long long i = 0; i < timeVector.size(); i++)
-        {
-            // Load step number and postion
-            step = timeVector[i];
-            position = positionVector[i];
-            // Save data to file
-            outfile << step << ", " << position << "\n";
-        }
+        writeHistogram(outfile, positionSpacing, histogram);
         outfile.close();
     }
-    catch (std::exception e)
+    catch (std::exception const &e)
     {
         std::cout << "Exception writing to file: " << filename << "\n"
                   << "Exception: " << e.what() << std::endl;
     }
 }
 
+void writeHistogram(
+    std::ostream &out,
+    float positionSpacing,
+    std::vector<unsigned long long> const &histogram
+    )
+{
+    // Print out header
+    out << "position" << ", " << "count" << "\n";
+    // Print out all bins
+    for (unsigned long i = 0; i < histogram.size(); i++)
+    {
+        out << i*positionSpacing << ", " << histogram[i] << "\n";
+    }
+}
+
+void writeHistogramToFile(
+    std::string const &filename,
+    float positionSpacing,
+    langevin_ensemble_output const &ensemble
+    )
+{
+    // Allocate variables
+    std::ofstream outfile;
+    
+    try
+    {
+        // Open file for writing
+        outfile.open(filename.c_str(), std::ios::out | std::ios::trunc);
+        writeHistogram(outfile, positionSpacing, ensemble);
+        outfile.close();
+    }
+    catch (std::exception const &e)
+    {
+        std::cout << "Exception writing to file: " << filename << "\n"
+                  << "Exception: " << e.what() << std::endl;
+    }
+}
+
+void writeHistogram(
+    std::ostream &out,
+    float positionSpacing,
+    langevin_ensemble_output const &ensemble
+    )
+{
+    // Print out header
+    out << "position" << ", " << "count" << ", " << "error" << "\n";
+    // Print out all bins with their block-averaging error
+    for (unsigned long i = 0; i < ensemble.histogram.size(); i++)
+    {
+        out << i*positionSpacing << ", " << ensemble.histogram[i]
+            << ", " << langevinHistogramError(ensemble, i) << "\n";
+    }
+}
+
+void writeEventsToFile(
+    std::string const &filename,
+    float timestep,
+    unsigned long long walkers,
+    langevin_ensemble_output const &ensemble
+    )
+{
+    // Allocate variables
+    std::ofstream outfile;
+    
+    try
+    {
+        // Open file for writing
+        outfile.open(filename.c_str(), std::ios::out | std::ios::trunc);
+        writeEvents(outfile, timestep, walkers, ensemble);
+        outfile.close();
+    }
+    catch (std::exception const &e)
+    {
+        std::cout << "Exception writing to file: " << filename << "\n"
+                  << "Exception: " << e.what() << std::endl;
+    }
+}
+
+void writeEvents(
+    std::ostream &out,
+    float timestep,
+    unsigned long long walkers,
+    langevin_ensemble_output const &ensemble
+    )
+{
+    double meanPassageTime = 0.0;
+    double meanPassageTimeError = langevinPassageError(ensemble)*timestep;
+    
+    if (ensemble.events > 0)
+    {
+        meanPassageTime =
+            (double)ensemble.eventSteps/(double)ensemble.events*timestep;
+    }
+    
+    // Print out header, the mean is a lower bound if walkers are censored
+    out << "walkers" << ", " << "walkerSteps" << ", " << "samples"
+        << ", " << "events" << ", " << "meanFirstPassageTime"
+        << ", " << "meanFirstPassageTimeError"
+        << ", " << "censoredWalkers" << "\n";
+    out << walkers << ", " << ensemble.walkerSteps << ", "
+        << ensemble.samples << ", " << ensemble.events << ", "
+        << meanPassageTime << ", " << meanPassageTimeError << ", "
+        << langevinCensoredWalkers(walkers, ensemble) << "\n";
+}
+
 template<typename Out>
 void split(
     const std::string &s,
@@ -41,10 +41,61 @@ void writeSimulationResultsToFile(
     langevin_simulation simu
     );
 
+/* digits: significant digits of the positions, see langevinPositionDigits */
 void writeTrajectoryToFile(
     std::string const &filename,
-    std::vector<float> const &positionVector,
-    std::vector<unsigned long long> const &timeVector
+    std::vector<double> const &positionVector,
+    std::vector<unsigned long long> const &timeVector,
+    int digits
+    );
+
+void writeTrajectory(
+    std::ostream &out,
+    std::vector<double> const &positionVector,
+    std::vector<unsigned long long> const &timeVector,
+    int digits
+    );
+
+void writeEnsembleResultsToFile(
+    langevin_simulation const &simu
+    );
+
+void writeHistogramToFile(
+    std::string const &filename,
+    float positionSpacing,
+    std::vector<unsigned long long> const &histogram
+    );
+
+void writeHistogram(
+    std::ostream &out,
+    float positionSpacing,
+    std::vector<unsigned long long> const &histogram
+    );
+
+void writeHistogramToFile(
+    std::string const &filename,
+    float positionSpacing,
+    langevin_ensemble_output const &ensemble
+    );
+
+void writeHistogram(
+    std::ostream &out,
+    float positionSpacing,
+    langevin_ensemble_output const &ensemble
+    );
+
+void writeEventsToFile(
+    std::string const &filename,
+    float timestep,
+    unsigned long long walkers,
+    langevin_ensemble_output const &ensemble
+    );
+
+void writeEvents(
+    std::ostream &out,
+    float timestep,
+    unsigned long long walkers,
+    langevin_ensemble_output const &ensemble
     );
 
 template<typename Out>
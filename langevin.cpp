@@ -17,23 +17,100 @@
 #include "langevin.h"
 #include "fileio.h"
 
+/* Prints the progress of a trajectory to the console */
+struct console_progress_observer : langevin_observer {
+    static const bool observeProgress = true;
+
+    void onProgress(unsigned long long step, unsigned long long steps)
+    {
+        int percent = (float)(step)/(float)(steps)*100;
+        std::cout << percent << "%.." << std::flush;
+    }
+};
+
+/* Runs a trajectory on the library engine with console progress */
+template <class Precision>
+static int runConsoleTrajectory(
+    langevin_configuration const &conf,
+    std::vector<double> &positionVector,
+    std::vector<unsigned long long> &timeVector
+    )
+{
+    /* Populate local force vectors */
+    std::cout << "  Pre-computing force step sizes... ";
+    langevin_tables_of<typename Precision::table_type> tables;
+    buildLangevinTables(conf, tables);
+    std::cout << "done.\n";
+    
+    /* Record the trajectory and report progress */
+    langevin_output out;
+    out.positionVector.swap(positionVector);
+    out.timeVector.swap(timeVector);
+    langevin_trajectory_recorder recorder(out);
+    console_progress_observer progress;
+    langevin_observer_pair<langevin_trajectory_recorder,
+                           console_progress_observer> both(recorder, progress);
+
+    /* Perform steps */
+    std::cout << "Running simulation for " << conf.steps << " steps.\n";
+    std::cout << "   0%.." << std::flush;
+    unsigned long long done =
+        runLangevinTrajectory<Precision>(conf, tables, both);
+    std::cout << ". done.\n" << std::endl;
+    if (done < conf.steps) {
+        std::cout << "Stopped after " << done << " steps ("
+                  << langevinStopString(SPBD_STOP_WALLCLOCK) << ").\n";
+    }
+    
+    out.positionVector.swap(positionVector);
+    out.timeVector.swap(timeVector);
+    
+    return 0;
+}
+
+struct console_trajectory_runner {
+    langevin_configuration const &conf;
+    std::vector<double> &positionVector;
+    std::vector<unsigned long long> &timeVector;
+
+    template <class Precision>
+    int run()
+    {
+        return runConsoleTrajectory<Precision>(
+            conf, positionVector, timeVector);
+    }
+};
+
+/* Checks the configuration and runs it with its precision policy */
+static int computeLangevinTrajectory(
+    langevin_configuration const &conf,
+    std::vector<double> &positionVector,
+    std::vector<unsigned long long> &timeVector
+    )
+{
+    std::cout << "Initializing simulation.\n";
+    
+    /* Check sanity of arguments */
+    std::cout << "  Checking arguments... ";
+    int status = validateLangevinConfiguration(conf);
+    if (status != SPBD_SUCCESS) {
+        std::cout << langevinErrorString(status) << ".\n";
+        return status;
+    }
+    std::cout << "done.\n";
+    
+    console_trajectory_runner runner = {conf, positionVector, timeVector};
+    return dispatchLangevinPrecision(conf.precision, runner);
+}
+
 int computeLangevinTrajectory(
     langevin_simulation &simu
     )
 {
     return computeLangevinTrajectory(
-        simu.conf.steps,
-        simu.conf.saveFreq,
-        simu.conf.timestep,
-        simu.conf.temperature,
-        simu.conf.damping,
-        simu.conf.positionStart,
-        simu.conf.positionSpacing,
-        simu.conf.forceVector,
-        simu.conf.dampingVector,
+        simu.conf,
         simu.out.positionVector,
-        simu.out.timeVector,
-        simu.conf.method);
+        simu.out.timeVector);
 }
 
 int computeLangevinTrajectory(
@@ -51,153 +128,23 @@ int computeLangevinTrajectory(
     const int method
     )
 {   
-    std::cout << "Initializing simulation.\n";
-    
-    /* Check sanity of arguments */
-    std::cout << "  Checking arguments... ";
-    
-    // size of positionVector, timeVector == int_round_down(steps/saveFreq)+1
-    // size of forceVector == dampingVector
-    // size of positionVector == timeVector
-    // spacingVector[0] <= positionStart <= spaceVector[end]
-    
-    std::cout << "done.\n";
-    
-    /* Allocate memory for force vectors */
-    std::vector<float> externalVector(forceVector.size());
-    std::vector<float> thermalVector(forceVector.size());
-    
-    
-    /* Populate local force vectors */
-    
-    // F/gamma
-    std::cout << "  Pre-computing external force step size... ";
-    
-    calcExternalStepVector( timestep,
-                            damping,
-                            forceVector,
-                            dampingVector,
-                            externalVector);
-                            
-    std::cout << "done.\n";
-    
-    // (kB*T*Dt/gamma)^0.5
-    std::cout << "  Pre-computing thermal force step size... ";
-    calcThermalStepVector( timestep,
-                           temperature,
-                           damping,
-                           dampingVector,
-                           thermalVector);
-    std::cout << "done.\n";
-    
-    /* Initialize random gaussian distribution */
-    std::cout << "  Pre-computing random guassian distribution... ";
-    std::default_random_engine generator;
-    std::normal_distribution<float> distribution(0.0,1.0);
-    std::cout << "done.\n";
-    
-    /* Set the initial position */
-    std::cout << "  Setting up initial particle position... ";
-    positionVector.push_back(positionStart);
-    timeVector.push_back(0);
-    std::cout << "done.\n";
-    
-    /*
-    std::cout << "Printing step vectors:\n";
-    std::cout << "Damped external force stepsize per position:\n";
-    printVector(externalVector,',');
-    std::cout << "Damped thermal force stepsize per position:\n";
-    printVector(thermalVector,',');
-    */
-    
-    // Allocate loop variables
-    float newPos = positionStart;
-    float oldPos = positionStart;
-    unsigned long long percentFreq = steps/20;
-    float minPos = 0.0;
-    float maxPos = (forceVector.size()-1)*positionSpacing;
-    unsigned long index = long(oldPos/positionSpacing);
-    float eForceStep = 0.0;
-    float tForceStep = 0.0;
-    int percent = 0;
-
-    /* Perform steps */
-    std::cout << "Running simulation for " << steps << " steps.\n";
-    std::cout << "   0%.." << std::flush;
-    for (unsigned long long s = 1; s != steps+1; s++) {
-
-        
-        // Calculate the index for this position and check for out-of-bounds
-        if (oldPos < minPos) {
-            index = long(minPos/positionSpacing);
-        } else if (oldPos > maxPos) {
-            index = long(maxPos/positionSpacing);
-        } else {
-            index = long(oldPos/positionSpacing);
-        }        
-        
-        // Grab external force at this position
-        eForceStep = externalVector[index];
-        // Grab thermal force at this position
-        tForceStep = thermalVector[index]*distribution(generator);
-        // Calculate new position
-        newPos = oldPos + eForceStep + tForceStep;
-        
-        // Save position and timestamp if needed
-        if (s % saveFreq == 0) {
-            positionVector.push_back(newPos);
-            timeVector.push_back(s);
-        }
-        if (s % percentFreq == 0) {
-            
-            percent = (float)(s)/(float)(steps)*100;
-            std::cout << percent << "%.." << std::flush;
-        }
-        // Overwrite oldPos for next iteration
-        oldPos = newPos;
-    }
-    std::cout << ". done.\n" << std::endl;
-    /* Cleanup */
-    
-    return 0;
-}
-
-int calcExternalStepVector(
-    float timestep,
-    float damping,
-    std::vector<float> const &forceVector,
-    std::vector<float> const &dampingVector,
-    std::vector<float> &externalVector)
-{
-    float forceV = 0.0;
-    float dampingV = 0.0;
-    float externalV = 0.0;
-    
-    for (unsigned int i = 0; i < externalVector.size(); i++) {
-        forceV = forceVector[i];
-        dampingV = dampingVector[i];
-        externalV = (forceV*timestep)/(damping*dampingV);
-        externalVector[i] = externalV;
-    }
-    return 0;
-}
-
-int calcThermalStepVector(
-    float timestep,
-    float temperature,
-    float damping,
-    std::vector<float> const &dampingVector,
-    std::vector<float> &thermalVector)
-{
-    float dampingV = 0.0;
-    float thermalV = 0.0;
+    langevin_configuration conf;
+    conf.steps = steps;
+    conf.saveFreq = saveFreq;
+    conf.timestep = timestep;
+    conf.temperature = temperature;
+    conf.damping = damping;
+    conf.positionStart = positionStart;
+    conf.positionSpacing = positionSpacing;
+    conf.forceVector = forceVector;
+    conf.dampingVector = dampingVector;
+    conf.method = method;
     
-    for (unsigned int i = 0; i < thermalVector.size(); i++) {
-        dampingV = dampingVector[i];
-        thermalV = std::sqrt((2*temperature*timestep)/(damping*dampingV));
-        thermalVector[i] = thermalV;
-    }
-    return 0;
+    // The float policy loses nothing when its positions are narrowed back
+    std::vector<double> positions;
+    int status = computeLangevinTrajectory(conf, positions, timeVector);
+    positionVector.insert(positionVector.end(), positions.begin(), positions.end());
+    return status;
 }
 
 template <typename T>
@@ -234,14 +181,28 @@ int loadConfiguration(
     )
 {
     // Allocate variables
-    std::vector<std::string> param_value;
     std::vector<std::string> lines;
     
     // Save filename to conf
     conf.name = filename;
     
     // Load all lines from configuration file
-    readFileToStrings(conf.name, lines);
+    if (readFileToStrings(conf.name, lines) != 0)
+    {
+        return -1;
+    }
+    
+    return parseConfiguration(lines, conf);
+}
+
+/* Converts the lines, throws on a value that is not a number */
+static int parseConfigurationLines(
+    std::vector<std::string> const &lines,
+    langevin_configuration &conf
+    )
+{
+    // Allocate variables
+    std::vector<std::string> param_value;
     
     // Convert all lines to configuration parameters
     for (unsigned int i=0; i<lines.size(); i++)
@@ -249,6 +210,10 @@ int loadConfiguration(
         std::string line = lines[i];
         // Extract parameter and value from line
         param_value = split(line, ' ');
+        if (param_value.size() < 2)
+        {
+            continue;
+        }
         const char* param = param_value[0].c_str();
         std::string value = param_value[1];
         
@@ -328,12 +293,113 @@ int loadConfiguration(
             conf.trajectoryOutputFile = param_value[1];
             continue;
         }
+        if(std::strcmp(param, "walkers") == 0)
+        {
+            conf.walkers = std::stoull(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "processes") == 0)
+        {
+            conf.processes = std::stoull(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "seed") == 0)
+        {
+            conf.seed = std::stoull(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "eventPosition") == 0)
+        {
+            conf.eventPosition = std::stof(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "histogramOutputFile") == 0)
+        {
+            conf.histogramOutputFile = param_value[1];
+            continue;
+        }
+        if(std::strcmp(param, "eventOutputFile") == 0)
+        {
+            conf.eventOutputFile = param_value[1];
+            continue;
+        }
+        if(std::strcmp(param, "pipeline") == 0)
+        {
+            conf.pipelineStages = split(value,',');
+            continue;
+        }
+        if(std::strcmp(param, "pipelineBackpressure") == 0)
+        {
+            conf.pipelineBackpressure = (param_value[1] == "block");
+            continue;
+        }
+        if(std::strcmp(param, "pipelineRingSize") == 0)
+        {
+            conf.pipelineRingSize = std::stoull(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "correlationLags") == 0)
+        {
+            conf.correlationLags = std::stoull(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "correlationOutputFile") == 0)
+        {
+            conf.correlationOutputFile = param_value[1];
+            continue;
+        }
+        if(std::strcmp(param, "blockSteps") == 0)
+        {
+            conf.blockSteps = std::stoull(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "equilibrationSteps") == 0)
+        {
+            conf.equilibrationSteps = std::stoull(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "targetRelativeError") == 0)
+        {
+            conf.targetRelativeError = std::stod(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "targetEvents") == 0)
+        {
+            conf.targetEvents = std::stoull(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "wallClockLimit") == 0)
+        {
+            conf.wallClockLimit = std::stod(param_value[1]);
+            continue;
+        }
+        if(std::strcmp(param, "precision") == 0)
+        {
+            conf.precision = langevinPrecisionFromString(param_value[1]);
+            continue;
+        }
         
     
     }
     return 0;
 }
 
+int parseConfiguration(
+    std::vector<std::string> const &lines,
+    langevin_configuration &conf
+    )
+{
+    // The std::sto* conversions throw on malformed numbers
+    try
+    {
+        return parseConfigurationLines(lines, conf);
+    }
+    catch (std::exception const &)
+    {
+        return SPBD_ERROR_PARSE;
+    }
+}
+
 void printConfiguration(
     langevin_configuration conf
     )
@@ -349,6 +415,24 @@ void printConfiguration(
     std::cout << "          positionSpacing: " << conf.positionSpacing      << "\n";
     std::cout << "                   method: " << conf.method               << "\n";
     std::cout << "     trajectoryOutputFile: " << conf.trajectoryOutputFile << "\n";
+    std::cout << "                  walkers: " << conf.walkers              << "\n";
+    std::cout << "                processes: " << conf.processes            << "\n";
+    std::cout << "                     seed: " << conf.seed                 << "\n";
+    std::cout << "            eventPosition: " << conf.eventPosition        << "\n";
+    std::cout << "      histogramOutputFile: " << conf.histogramOutputFile  << "\n";
+    std::cout << "          eventOutputFile: " << conf.eventOutputFile      << "\n";
+    std::cout << "     pipelineBackpressure: " << conf.pipelineBackpressure << "\n";
+    std::cout << "         pipelineRingSize: " << conf.pipelineRingSize     << "\n";
+    std::cout << "          correlationLags: " << conf.correlationLags      << "\n";
+    std::cout << "    correlationOutputFile: " << conf.correlationOutputFile << "\n";
+    std::cout << "               blockSteps: " << conf.blockSteps           << "\n";
+    std::cout << "       equilibrationSteps: " << conf.equilibrationSteps   << "\n";
+    std::cout << "      targetRelativeError: " << conf.targetRelativeError  << "\n";
+    std::cout << "             targetEvents: " << conf.targetEvents         << "\n";
+    std::cout << "           wallClockLimit: " << conf.wallClockLimit       << "\n";
+    std::cout << "                precision: " << langevinPrecisionString(conf.precision) << "\n";
+    std::cout << "                 pipeline:\n";
+    printVector(conf.pipelineStages, ',');
     std::cout << "              forceVector:\n";
     printVector(conf.forceVector, ',');
     std::cout << "            dampingVector:\n";
@@ -31,30 +31,7 @@
 #include <cstring>
 #include <string>
 
-struct langevin_configuration {
-    std::string name;
-    unsigned long long steps;
-    unsigned long long saveFreq;
-    float timestep;
-    float temperature;
-    float damping;
-    float positionStart;
-    float positionSpacing;
-    std::vector<float> forceVector;
-    std::vector<float> dampingVector;
-    int method;
-    std::string trajectoryOutputFile;
-};
-
-struct langevin_output {
-    std::vector<float> positionVector;
-    std::vector<unsigned long long> timeVector;
-};
-
-struct langevin_simulation {
-    langevin_configuration conf;
-    langevin_output out;
-};
+#include "spbd.h"
 
 /** 
  * @brief   Computes a Langevin trajectory for given parameters
@@ -101,44 +78,6 @@ int computeLangevinTrajectory(
     );
 
 
-/** 
- * @brief   Compute external force langevin step size vector
- * @ingroup Langevin
- * @author  Kherim Willems
- * @param   timestep        Size of the integration timestep [ns]
- * @param   damping         Damping constant of particle [pN*ns/nm]
- * @param   forceVector     Vector containing the force distribution [pN]
- * @param   dampingVector   Vector containing the distribution of relative damping constants at each position [1]
- * @param   externalVector  Output vector containing thermal step [nm]
- * @returns 0 on success
- */    
-int calcExternalStepVector(
-    float timestep,
-    float damping,
-    std::vector<float> const &forceVector,
-    std::vector<float> const &dampingVector,
-    std::vector<float> &externalVector
-    );
-
-/** 
- * @brief   Compute thermal force langevin step size vector
- * @ingroup Langevin
- * @author  Kherim Willems
- * @param   timestep        Size of the integration timestep [ns]
- * @param   temperature     Temperature of the simulation kB*T [pN*nm]
- * @param   damping         Damping constant of particle [pN*ns/nm]
- * @param   dampingVector   Vector containing the distribution of relative damping constants at each position [1]
- * @param   thermalVector   Output vector containing thermal step [nm]
- * @returns 0 on success
- */
-int calcThermalStepVector(
-    float timestep,
-    float temperature,
-    float damping,
-    std::vector<float> const &dampingVector,
-    std::vector<float> &thermalVector
-    );
-    
 /** 
  * @brief   Compute thermal force langevin step size vector
  * @ingroup Langevin
@@ -174,12 +113,25 @@ void buildForceVector(
  * @author  Kherim Willems
  * @param   filename         Spacing between points
  * @param   conf             Minimum position to evaluate
- * @returns 0 on succes
+ * @returns 0 on succes, -1 if the file cannot be read
  * */    
 int loadConfiguration(
     std::string const &filename,
     langevin_configuration &conf
     );
+
+/** 
+ * @brief   Parses langevin simulation configuration lines
+ * @ingroup Langevin
+ * @author  Kherim Willems
+ * @param   lines            Lines of "parameter value" pairs
+ * @param   conf             Configuration to fill in
+ * @returns 0 on succes, SPBD_ERROR_PARSE on a malformed number
+ * */    
+int parseConfiguration(
+    std::vector<std::string> const &lines,
+    langevin_configuration &conf
+    );
     
 /** 
  * @brief   Prints the parameters of a langevin simulation configuration
@@ -1,9 +1,121 @@
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include "langevin.h"
 #include "fileio.h"
+#include "ensemble.h"
+#include "pipeline.h"
+#include "server.h"
 
 
+/* Options given on the command line */
+struct spbd_arguments {
+    std::string confFile;
+    std::string outputFile;
+    std::string socketPath;
+    unsigned int threads = 0;
+    bool server = false;
+    bool help = false;
+    bool version = false;
+};
+
+/**
+ * @brief   Parses the command line options listed in the usage text
+ * @param   argc    Number of arguments
+ * @param   argv    Arguments
+ * @param   args    Parsed options
+ * @returns 0 on success, -1 on an unknown option or missing input file
+ */
+static int parseArguments(
+    int argc,
+    char **argv,
+    spbd_arguments &args
+    )
+{
+    const std::string outputOption("--output-file=");
+    const std::string serverOption("--server=");
+    const std::string threadsOption("--threads=");
+    
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        
+        if (arg == "--help")
+        {
+            args.help = true;
+            continue;
+        }
+        if (arg == "--version")
+        {
+            args.version = true;
+            continue;
+        }
+        if (arg.compare(0, outputOption.size(), outputOption) == 0)
+        {
+            args.outputFile = arg.substr(outputOption.size());
+            if (args.outputFile.empty())
+            {
+                std::cout << "Option --output-file needs a file name.\n";
+                return -1;
+            }
+            continue;
+        }
+        if (arg == "--server")
+        {
+            args.server = true;
+            continue;
+        }
+        if (arg.compare(0, serverOption.size(), serverOption) == 0)
+        {
+            args.server = true;
+            args.socketPath = arg.substr(serverOption.size());
+            continue;
+        }
+        if (arg.compare(0, threadsOption.size(), threadsOption) == 0)
+        {
+            std::string value = arg.substr(threadsOption.size());
+            char *end = NULL;
+            errno = 0;
+            unsigned long threads = std::strtoul(value.c_str(), &end, 10);
+            if (value.empty() || value[0] == '-' || *end != '\0'
+                || errno != 0 || threads == 0 || threads > UINT_MAX)
+            {
+                std::cout << "Option --threads needs a positive number.\n";
+                return -1;
+            }
+            args.threads = threads;
+            continue;
+        }
+        if (arg.size() > 1 && arg[0] == '-')
+        {
+            std::cout << "Unknown option: " << arg << "\n";
+            return -1;
+        }
+        if (!args.confFile.empty())
+        {
+            std::cout << "More than one input file given: " << arg << "\n";
+            return -1;
+        }
+        args.confFile = arg;
+    }
+    
+    if (args.confFile.empty() && !args.help && !args.version && !args.server)
+    {
+        std::cout << "No input file given.\n";
+        return -1;
+    }
+    return 0;
+}
+
+/* Library status codes are negative, the exit code is their magnitude */
+static int exitCode(
+    int status
+    )
+{
+    return status < 0 ? -status : status;
+}
 
 int main(
          int argc,
@@ -22,26 +134,69 @@ int main(
     This program performs a 1D brownian dynamics simulation on a\n\
     single particle trapped inside a force profile.\n\
         Usage:\n\n\
-        spdb [options] spdb.in\n\n\
+        spdb [options] spdb.in\n\
+        spdb --server[=<socket>] [--threads=<n>]\n\n\
         where spdb.in is a formatted input file and [options] are:\n\n\
 --output-file=<name>     Enables output logging to the path\n\
     listed in <name>.  Uses flat-file format.\n\
+--server[=<socket>]      Run as a job server reading jobs from\n\
+    stdin, or from the Unix domain socket <socket>.\n\
+--threads=<n>            Number of server threads, default one\n\
+    per core.\n\
 --help                   Display this help information.\n\
 --version                Display the current SPDB version.\n\
 ----------------------------------------------------------------------\n\n"};
 
-    //std::cout << header;
-    //std::cout << usage;
+    spbd_arguments args;
+    if (parseArguments(argc, argv, args) != 0)
+    {
+        std::cout << usage;
+        return 1;
+    }
+    if (args.help)
+    {
+        std::cout << header << usage;
+        return 0;
+    }
+    if (args.version)
+    {
+        std::cout << "spbd " << SPBD_VERSION << "\n";
+        return 0;
+    }
+    
+    if (args.server)
+    {
+        unsigned int threads = args.threads > 0 ?
+            args.threads : std::thread::hardware_concurrency();
+        if (args.socketPath.empty())
+        {
+            return runStdioServer(threads) == 0 ? 0 : 1;
+        }
+        return runSocketServer(args.socketPath, threads) == 0 ? 0 : 1;
+    }
     
     bool debug = false;
-    std::string conf_file("test/test_conf.txt");
+    std::string conf_file(args.confFile);
     
     // Create new simulation object
     langevin_simulation simulation;
     
     
     std::cout << "Loading configuration file... ";
-    loadConfiguration(conf_file, simulation.conf);
+    int status = loadConfiguration(conf_file, simulation.conf);
+    if (status == SPBD_ERROR_PARSE)
+    {
+        std::cout << langevinErrorString(status) << ".\n";
+        return exitCode(status);
+    }
+    if (status != 0)
+    {
+        return 1;
+    }
+    if (!args.outputFile.empty())
+    {
+        simulation.conf.trajectoryOutputFile = args.outputFile;
+    }
     
     if (debug)
     {
@@ -49,6 +204,59 @@ int main(
     printConfiguration(simulation.conf);
     }
     
+    status = validateLangevinConfiguration(simulation.conf);
+    if (status != SPBD_SUCCESS)
+    {
+        std::cout << langevinErrorString(status) << ".\n";
+        return exitCode(status);
+    }
+    
+    // Walker ensemble, optionally sharded over worker processes
+    if (simulation.conf.walkers > 0)
+    {
+        status = computeLangevinEnsemble(simulation);
+        if (status != SPBD_SUCCESS)
+        {
+            return exitCode(status);
+        }
+        
+        std::cout << "Ensemble stopped: "
+                  << langevinStopString(simulation.ensemble.stopReason)
+                  << " after " << simulation.ensemble.walkerSteps
+                  << " walker steps.\n";
+        std::cout << "  Histogram relative error: "
+                  << langevinHistogramRelativeError(simulation.ensemble) << "\n";
+        std::cout << "  First passages: " << simulation.ensemble.events;
+        if (!std::isnan(simulation.conf.eventPosition))
+        {
+            std::cout << " (" << langevinCensoredWalkers(
+                simulation.conf.walkers, simulation.ensemble)
+                      << " walkers censored)";
+        }
+        std::cout << "\n";
+        
+        std::cout << "Writing ensemble data to disk... ";
+        writeEnsembleResultsToFile(simulation);
+        std::cout << "done.\n";
+        
+        return 0;
+    }
+    
+    // Stream the trajectory through analysis stages instead of storing it
+    if (!simulation.conf.pipelineStages.empty())
+    {
+        analysis_pipeline pipeline(simulation.conf.pipelineRingSize,
+                                   simulation.conf.pipelineBackpressure);
+        if (buildAnalysisPipeline(simulation.conf, pipeline) != 0)
+        {
+            return 1;
+        }
+        pipeline.start();
+        status = computeLangevinPipeline(simulation, pipeline);
+        
+        return exitCode(status);
+    }
+    
     std::cout << "Reserving memory space... ";
     unsigned long long output_elements =
         int((simulation.conf.steps/simulation.conf.saveFreq)+1);
@@ -56,7 +264,11 @@ int main(
     simulation.out.timeVector.reserve(output_elements);
     std::cout << "done.\n";
     
-    computeLangevinTrajectory(simulation);
+    status = computeLangevinTrajectory(simulation);
+    if (status != SPBD_SUCCESS)
+    {
+        return exitCode(status);
+    }
     
     std::cout << "Writing data to disk (" << simulation.conf.trajectoryOutputFile <<")... ";
     writeSimulationResultsToFile(simulation);
@@ -0,0 +1,496 @@
+/**
+ * @file    pipeline.cpp
+ * @ingroup Pipeline
+ * @brief   Routines for streaming trajectories through analysis stages
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "pipeline.h"
+#include "fileio.h"
+
+/* Empty polls before a consumer starts yielding its core */
+#define SPBD_SPIN_POLLS 64
+
+analysis_pipeline::analysis_pipeline(size_t ringBlocks, bool backpressure)
+    : ringBlocks(ringBlocks), backpressure(backpressure), started(false),
+      closed(false)
+{
+}
+
+analysis_pipeline::~analysis_pipeline()
+{
+    close();
+}
+
+void analysis_pipeline::addStage(analysis_stage *stage)
+{
+    lanes.push_back(std::unique_ptr<lane>(new lane(stage, ringBlocks)));
+}
+
+void analysis_pipeline::start()
+{
+    for (size_t i = 0; i < lanes.size(); i++) {
+        lanes[i]->thread = std::thread(runLane, lanes[i].get(), &closed);
+    }
+    pinThreads();
+    started = true;
+}
+
+void analysis_pipeline::publish(sample_block const &block)
+{
+    for (size_t i = 0; i < lanes.size(); i++) {
+        if (lanes[i]->ring.tryPush(block)) {
+            continue;
+        }
+        if (!backpressure) {
+            lanes[i]->dropped.fetch_add(1, std::memory_order_relaxed);
+            lanes[i]->droppedSamples.fetch_add(block.count,
+                                               std::memory_order_relaxed);
+            continue;
+        }
+        while (!lanes[i]->ring.tryPush(block)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void analysis_pipeline::close()
+{
+    if (!started) {
+        return;
+    }
+    closed.store(true, std::memory_order_release);
+    for (size_t i = 0; i < lanes.size(); i++) {
+        lanes[i]->thread.join();
+    }
+    unpinIntegrator();
+    started = false;
+}
+
+void analysis_pipeline::pinThreads()
+{
+#ifdef __linux__
+    // Only pin when the integrator and every stage get a core of their own
+    // out of the ones this process may run on
+    unsigned int cores = std::thread::hardware_concurrency();
+    cpu_set_t allowed;
+    pthread_t self = pthread_self();
+    if (cores <= lanes.size()
+        || pthread_getaffinity_np(self, sizeof(cpu_set_t), &allowed) != 0) {
+        return;
+    }
+    std::vector<int> usable;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            usable.push_back(cpu);
+        }
+    }
+    if (usable.size() <= lanes.size()) {
+        return;
+    }
+
+    cpu_set_t cpus;
+    for (size_t i = 0; i < lanes.size(); i++) {
+        CPU_ZERO(&cpus);
+        CPU_SET(usable[i+1], &cpus);
+        pthread_setaffinity_np(lanes[i]->thread.native_handle(),
+                               sizeof(cpu_set_t), &cpus);
+    }
+    CPU_ZERO(&cpus);
+    CPU_SET(usable[0], &cpus);
+    if (pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpus) == 0) {
+        integratorCores = usable;
+        integrator = self;
+    }
+#endif
+}
+
+void analysis_pipeline::unpinIntegrator()
+{
+#ifdef __linux__
+    if (integratorCores.empty()) {
+        return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (size_t i = 0; i < integratorCores.size(); i++) {
+        CPU_SET(integratorCores[i], &cpus);
+    }
+    pthread_setaffinity_np(integrator, sizeof(cpu_set_t), &cpus);
+    integratorCores.clear();
+#endif
+}
+
+size_t analysis_pipeline::stages() const
+{
+    return lanes.size();
+}
+
+const char *analysis_pipeline::stageName(size_t stage) const
+{
+    return lanes[stage]->stage->name();
+}
+
+unsigned long long analysis_pipeline::dropped(size_t stage) const
+{
+    return lanes[stage]->dropped.load(std::memory_order_relaxed);
+}
+
+void analysis_pipeline::runLane(lane *l, std::atomic<bool> const *closed)
+{
+    unsigned int idle = 0;
+    unsigned long long samples = 0;
+
+    while (true) {
+        sample_block *block = l->ring.front();
+        if (block != NULL) {
+            l->stage->consume(*block);
+            samples += block->count;
+            l->ring.pop();
+            idle = 0;
+            continue;
+        }
+        if (closed->load(std::memory_order_acquire)) {
+            // Everything published before close() is visible now
+            if (l->ring.front() == NULL) {
+                break;
+            }
+            continue;
+        }
+        if (++idle > SPBD_SPIN_POLLS) {
+            std::this_thread::yield();
+        }
+    }
+    // The drop counts are final: every publish() came before close()
+    stage_coverage coverage;
+    coverage.samples = samples;
+    coverage.droppedBlocks = l->dropped.load(std::memory_order_relaxed);
+    coverage.droppedSamples = l->droppedSamples.load(std::memory_order_relaxed);
+    l->stage->finish(coverage);
+}
+
+/* Marks the output of a stage that lost blocks with what it has seen */
+static void writeCoverage(
+    std::ostream &out,
+    stage_coverage const &coverage
+    )
+{
+    if (coverage.droppedBlocks == 0) {
+        return;
+    }
+    unsigned long long total = coverage.samples + coverage.droppedSamples;
+    out << "# incomplete: dropped " << coverage.droppedBlocks << " blocks, "
+        << coverage.droppedSamples << " of " << total << " samples, coverage "
+        << (double)coverage.samples/total << "\n";
+}
+
+trajectory_writer_stage::trajectory_writer_stage(
+    std::string const &filename,
+    int digits)
+    : filename(filename)
+{
+    outfile.open(filename.c_str(), std::ios::out | std::ios::trunc);
+    outfile.precision(digits);
+    outfile << "step" << ", " << "position" << "\n";
+}
+
+void trajectory_writer_stage::consume(sample_block const &block)
+{
+    for (unsigned int i = 0; i < block.count; i++) {
+        outfile << block.step[i] << ", " << block.position[i] << "\n";
+    }
+}
+
+void trajectory_writer_stage::finish(stage_coverage const &coverage)
+{
+    writeCoverage(outfile, coverage);
+    outfile.close();
+}
+
+histogram_stage::histogram_stage(
+    std::string const &filename,
+    float positionSpacing,
+    unsigned long bins)
+    : filename(filename), histogram(bins, 0)
+{
+    setLangevinGrid(positionSpacing, bins, grid);
+}
+
+void histogram_stage::consume(sample_block const &block)
+{
+    for (unsigned int i = 0; i < block.count; i++) {
+        histogram[langevinIndex(grid, block.position[i])]++;
+    }
+}
+
+void histogram_stage::finish(stage_coverage const &coverage)
+{
+    std::ofstream outfile;
+
+    try
+    {
+        outfile.open(filename.c_str(), std::ios::out | std::ios::trunc);
+        writeCoverage(outfile, coverage);
+        writeHistogram(outfile, grid.positionSpacing, histogram);
+        outfile.close();
+    }
+    catch (std::exception const &e)
+    {
+        std::cout << "Exception writing to file: " << filename << "\n"
+                  << "Exception: " << e.what() << std::endl;
+    }
+}
+
+correlator_stage::correlator_stage(
+    std::string const &filename,
+    float sampleTime,
+    unsigned long maxLag)
+    : filename(filename), sampleTime(sampleTime), history(maxLag+1, 0.0),
+      productSum(maxLag+1, 0.0), productCount(maxLag+1, 0), sum(0.0), count(0)
+{
+}
+
+void correlator_stage::consume(sample_block const &block)
+{
+    const unsigned long lags = history.size();
+
+    for (unsigned int i = 0; i < block.count; i++) {
+        double x = block.position[i];
+        unsigned long slot = count % lags;
+        history[slot] = x;
+
+        // Products with the previous samples still in the history
+        unsigned long available = count < lags ? count+1 : lags;
+        for (unsigned long lag = 0; lag < available; lag++) {
+            productSum[lag] += x*history[(slot + lags - lag) % lags];
+            productCount[lag]++;
+        }
+        sum += x;
+        count++;
+    }
+}
+
+void correlator_stage::finish(stage_coverage const &coverage)
+{
+    std::ofstream outfile;
+
+    try
+    {
+        outfile.open(filename.c_str(), std::ios::out | std::ios::trunc);
+        writeCoverage(outfile, coverage);
+        outfile << "lag" << ", " << "time" << ", " << "autocorrelation" << "\n";
+        if (count > 0)
+        {
+            double mean = sum/count;
+            double variance = productSum[0]/productCount[0] - mean*mean;
+            for (unsigned long lag = 0; lag < productSum.size(); lag++)
+            {
+                if (productCount[lag] == 0 || variance <= 0.0) {
+                    break;
+                }
+                double covariance =
+                    productSum[lag]/productCount[lag] - mean*mean;
+                outfile << lag << ", " << lag*sampleTime << ", "
+                        << covariance/variance << "\n";
+            }
+        }
+        outfile.close();
+    }
+    catch (std::exception const &e)
+    {
+        std::cout << "Exception writing to file: " << filename << "\n"
+                  << "Exception: " << e.what() << std::endl;
+    }
+}
+
+event_detector_stage::event_detector_stage(
+    std::string const &filename,
+    float eventPosition,
+    float timestep)
+    : filename(filename), eventPosition(eventPosition), timestep(timestep),
+      started(false), below(false), samples(0), crossings(0),
+      firstPassageStep(0)
+{
+}
+
+void event_detector_stage::consume(sample_block const &block)
+{
+    for (unsigned int i = 0; i < block.count; i++) {
+        bool nowBelow = block.position[i] < eventPosition;
+        if (started && nowBelow != below) {
+            if (crossings == 0) {
+                firstPassageStep = block.step[i];
+            }
+            crossings++;
+        }
+        below = nowBelow;
+        started = true;
+    }
+    samples += block.count;
+}
+
+void event_detector_stage::finish(stage_coverage const &coverage)
+{
+    std::ofstream outfile;
+
+    try
+    {
+        outfile.open(filename.c_str(), std::ios::out | std::ios::trunc);
+        writeCoverage(outfile, coverage);
+        outfile << "samples" << ", " << "crossings" << ", "
+                << "firstPassageTime" << "\n";
+        outfile << samples << ", " << crossings << ", "
+                << firstPassageStep*timestep << "\n";
+        outfile.close();
+    }
+    catch (std::exception const &e)
+    {
+        std::cout << "Exception writing to file: " << filename << "\n"
+                  << "Exception: " << e.what() << std::endl;
+    }
+}
+
+int buildAnalysisPipeline(
+    langevin_configuration const &conf,
+    analysis_pipeline &pipeline
+    )
+{
+    for (unsigned int i = 0; i < conf.pipelineStages.size(); i++)
+    {
+        std::string const &stage = conf.pipelineStages[i];
+
+        if (stage == "writer")
+        {
+            pipeline.addStage(new trajectory_writer_stage(
+                conf.trajectoryOutputFile,
+                langevinPositionDigits(conf.precision)));
+            continue;
+        }
+        if (stage == "histogram")
+        {
+            pipeline.addStage(new histogram_stage(conf.histogramOutputFile,
+                conf.positionSpacing, conf.forceVector.size()));
+            continue;
+        }
+        if (stage == "correlator")
+        {
+            pipeline.addStage(new correlator_stage(conf.correlationOutputFile,
+                conf.saveFreq*conf.timestep, conf.correlationLags));
+            continue;
+        }
+        if (stage == "events")
+        {
+            pipeline.addStage(new event_detector_stage(conf.eventOutputFile,
+                conf.eventPosition, conf.timestep));
+            continue;
+        }
+
+        std::cout << "Unknown pipeline stage: " << stage << "\n";
+        return -1;
+    }
+    return 0;
+}
+
+/* Collects samples into a block and publishes it once full */
+struct pipeline_publisher : langevin_observer {
+    static const bool observeSamples = true;
+
+    analysis_pipeline &pipeline;
+    sample_block &block;
+
+    pipeline_publisher(analysis_pipeline &pipeline, sample_block &block)
+        : pipeline(pipeline), block(block) {}
+
+    template <class Position>
+    void onSample(unsigned long long, unsigned long long step, Position pos)
+    {
+        block.step[block.count] = step;
+        block.position[block.count] = pos;
+        if (++block.count == SPBD_SAMPLE_BLOCK_SIZE) {
+            pipeline.publish(block);
+            block.count = 0;
+        }
+    }
+};
+
+/* Runs the trajectory of a pipeline with the tables and walker of a policy */
+template <class Precision>
+static int runPipelineTrajectory(
+    langevin_configuration const &conf,
+    analysis_pipeline &pipeline
+    )
+{
+    std::cout << "  Pre-computing force step sizes... ";
+    langevin_tables_of<typename Precision::table_type> tables;
+    buildLangevinTables(conf, tables);
+    std::cout << "done.\n";
+
+    // The block is published by copy, so one buffer is enough
+    std::unique_ptr<sample_block> block(new sample_block);
+    block->count = 0;
+    pipeline_publisher publisher(pipeline, *block);
+
+    std::cout << "Running simulation for " << conf.steps << " steps with "
+              << pipeline.stages() << " analysis stages... " << std::flush;
+    runLangevinTrajectory<Precision>(conf, tables, publisher);
+    if (block->count > 0) {
+        pipeline.publish(*block);
+    }
+    pipeline.close();
+    std::cout << "done.\n";
+
+    for (size_t i = 0; i < pipeline.stages(); i++) {
+        if (pipeline.dropped(i) > 0) {
+            std::cout << "  Stage " << pipeline.stageName(i) << " dropped "
+                      << pipeline.dropped(i)
+                      << " blocks, its output is marked incomplete.\n";
+        }
+    }
+    std::cout << std::endl;
+
+    return 0;
+}
+
+struct pipeline_runner {
+    langevin_configuration const &conf;
+    analysis_pipeline &pipeline;
+
+    template <class Precision>
+    int run()
+    {
+        return runPipelineTrajectory<Precision>(conf, pipeline);
+    }
+};
+
+int computeLangevinPipeline(
+    langevin_simulation &simu,
+    analysis_pipeline &pipeline
+    )
+{
+    std::cout << "Initializing pipeline simulation.\n";
+
+    int status = validateLangevinConfiguration(simu.conf);
+    if (status != SPBD_SUCCESS) {
+        std::cout << "  " << langevinErrorString(status) << ".\n";
+        pipeline.close();
+        return status;
+    }
+
+    pipeline_runner runner = {simu.conf, pipeline};
+    return dispatchLangevinPrecision(simu.conf.precision, runner);
+}
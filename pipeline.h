@@ -0,0 +1,214 @@
+/**
+ * @defgroup  Pipeline  Analysis pipeline
+ * @brief     Streams trajectory samples to concurrent analysis stages
+*/
+/**
+ * @file    pipeline.h
+ * @ingroup Pipeline
+ * @brief   Contains declarations for the analysis pipeline and its stages
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#ifndef _LANGEVINPIPELINE_H_
+#define _LANGEVINPIPELINE_H_
+
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "langevin.h"
+#include "ringbuffer.h"
+
+/* Number of samples published to the stages at once */
+#define SPBD_SAMPLE_BLOCK_SIZE 1024
+
+struct sample_block {
+    unsigned int count;
+    unsigned long long step[SPBD_SAMPLE_BLOCK_SIZE];
+    double position[SPBD_SAMPLE_BLOCK_SIZE];
+};
+
+/* Samples a stage consumed and lost to a full ring over a run */
+struct stage_coverage {
+    unsigned long long samples;
+    unsigned long long droppedBlocks;
+    unsigned long long droppedSamples;
+};
+
+/**
+ * @brief   Interface of a pipeline stage
+ * @ingroup Pipeline
+ * @author  Kherim Willems
+ *
+ * consume() and finish() are only ever called from the stage's own thread.
+ * The coverage handed to finish() tells the stage how much of the run it
+ * has seen, stages that lost blocks mark their output as incomplete.
+ */
+class analysis_stage {
+public:
+    virtual ~analysis_stage() {}
+    virtual const char *name() const = 0;
+    virtual void consume(sample_block const &block) = 0;
+    virtual void finish(stage_coverage const &) {}
+};
+
+/**
+ * @brief   Fans sample blocks out to stages, one thread and ring per stage
+ * @ingroup Pipeline
+ * @author  Kherim Willems
+ *
+ * Without backpressure publish() never waits: a block that does not fit
+ * in the ring of a stage is dropped for that stage and counted. With
+ * backpressure publish() waits until there is room.
+ *
+ * When the process may run on more cores than there are stages, start()
+ * pins the calling (integrator) thread and every stage to cores of their
+ * own; close() gives the integrator its previous affinity back.
+ */
+class analysis_pipeline {
+public:
+    analysis_pipeline(size_t ringBlocks, bool backpressure);
+    ~analysis_pipeline();
+
+    /* Takes ownership of stage, must be called before start() */
+    void addStage(analysis_stage *stage);
+    void start();
+    void publish(sample_block const &block);
+    void close();
+
+    size_t stages() const;
+    const char *stageName(size_t stage) const;
+    unsigned long long dropped(size_t stage) const;
+
+private:
+    struct lane {
+        explicit lane(analysis_stage *s, size_t ringBlocks)
+            : stage(s), ring(ringBlocks), dropped(0), droppedSamples(0) {}
+        std::unique_ptr<analysis_stage> stage;
+        spsc_ring<sample_block> ring;
+        std::thread thread;
+        std::atomic<unsigned long long> dropped;
+        std::atomic<unsigned long long> droppedSamples;
+    };
+
+    static void runLane(lane *l, std::atomic<bool> const *closed);
+    void pinThreads();
+    void unpinIntegrator();
+
+    std::vector<std::unique_ptr<lane> > lanes;
+    size_t ringBlocks;
+    bool backpressure;
+    bool started;
+    std::atomic<bool> closed;
+
+    /* Cores the integrator could run on before start(), empty if not pinned */
+    std::vector<int> integratorCores;
+    std::thread::native_handle_type integrator;
+};
+
+/*
+ * Writes the samples to a trajectory file, same format as
+ * writeTrajectoryToFile. Set pipelineBackpressure for a complete file.
+ */
+class trajectory_writer_stage : public analysis_stage {
+public:
+    trajectory_writer_stage(std::string const &filename, int digits);
+    const char *name() const { return "writer"; }
+    void consume(sample_block const &block);
+    void finish(stage_coverage const &coverage);
+private:
+    std::string filename;
+    std::ofstream outfile;
+};
+
+/* Position histogram on the force grid */
+class histogram_stage : public analysis_stage {
+public:
+    histogram_stage(std::string const &filename, float positionSpacing,
+                    unsigned long bins);
+    const char *name() const { return "histogram"; }
+    void consume(sample_block const &block);
+    void finish(stage_coverage const &coverage);
+private:
+    std::string filename;
+    langevin_grid grid;
+    std::vector<unsigned long long> histogram;
+};
+
+/* Position autocorrelation function up to maxLag samples */
+class correlator_stage : public analysis_stage {
+public:
+    correlator_stage(std::string const &filename, float sampleTime,
+                     unsigned long maxLag);
+    const char *name() const { return "correlator"; }
+    void consume(sample_block const &block);
+    void finish(stage_coverage const &coverage);
+private:
+    std::string filename;
+    float sampleTime;
+    std::vector<double> history;
+    std::vector<double> productSum;
+    std::vector<unsigned long long> productCount;
+    double sum;
+    unsigned long long count;
+};
+
+/* Crossings of the event position between consecutive samples */
+class event_detector_stage : public analysis_stage {
+public:
+    event_detector_stage(std::string const &filename, float eventPosition,
+                         float timestep);
+    const char *name() const { return "events"; }
+    void consume(sample_block const &block);
+    void finish(stage_coverage const &coverage);
+private:
+    std::string filename;
+    float eventPosition;
+    float timestep;
+    bool started;
+    bool below;
+    unsigned long long samples;
+    unsigned long long crossings;
+    unsigned long long firstPassageStep;
+};
+
+/**
+ * @brief   Adds the stages listed in conf.pipelineStages to a pipeline
+ * @ingroup Pipeline
+ * @author  Kherim Willems
+ * @param   conf        Simulation configuration
+ * @param   pipeline    Pipeline to add the stages to
+ * @returns 0 on success, -1 on an unknown stage name
+ */
+int buildAnalysisPipeline(
+    langevin_configuration const &conf,
+    analysis_pipeline &pipeline
+    );
+
+/**
+ * @brief   Computes a Langevin trajectory and streams it through a pipeline
+ * @ingroup Pipeline
+ * @author  Kherim Willems
+ * @param   simu        Simulation object, simu.out is left untouched
+ * @param   pipeline    Started pipeline, closed on return
+ * @returns 0 on success
+ */
+int computeLangevinPipeline(
+    langevin_simulation &simu,
+    analysis_pipeline &pipeline
+    );
+
+#endif
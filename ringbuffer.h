@@ -0,0 +1,109 @@
+/**
+ * @file    ringbuffer.h
+ * @ingroup Pipeline
+ * @brief   Lock-free single-producer/single-consumer ring buffer
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#ifndef _LANGEVINRINGBUFFER_H_
+#define _LANGEVINRINGBUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/* Assumed cache line size, used to keep producer and consumer indices apart */
+#define SPBD_CACHE_LINE 64
+
+/**
+ * @brief   Bounded ring buffer for exactly one producer and one consumer thread
+ * @ingroup Pipeline
+ * @author  Kherim Willems
+ *
+ * The producer only writes tail, the consumer only writes head. Slots are
+ * preallocated, so neither side allocates after construction.
+ */
+template <typename T>
+class spsc_ring {
+public:
+    /**
+     * @brief   Creates a ring holding at least capacity elements
+     * @param   capacity    Minimum number of elements, rounded up to a power of two
+     */
+    explicit spsc_ring(size_t capacity)
+        : head(0), tail(0)
+    {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots.resize(size);
+        mask = size-1;
+    }
+
+    /**
+     * @brief   Copies value into the ring (producer side)
+     * @returns false if the ring is full
+     */
+    bool tryPush(T const &value)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        slots[t & mask] = value;
+        tail.store(t+1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief   Oldest element in the ring (consumer side)
+     * @returns NULL if the ring is empty
+     */
+    T *front()
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+        return &slots[h & mask];
+    }
+
+    /**
+     * @brief   Releases the element returned by front() (consumer side)
+     */
+    void pop()
+    {
+        head.store(head.load(std::memory_order_relaxed)+1,
+                   std::memory_order_release);
+    }
+
+    size_t capacity() const
+    {
+        return mask+1;
+    }
+
+private:
+    spsc_ring(spsc_ring const &);
+    spsc_ring &operator=(spsc_ring const &);
+
+    std::vector<T> slots;
+    size_t mask;
+    char padHead[SPBD_CACHE_LINE];
+    std::atomic<size_t> head;
+    char padTail[SPBD_CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+    char padEnd[SPBD_CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+#endif
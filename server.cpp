@@ -0,0 +1,531 @@
+/**
+ * @file    server.cpp
+ * @ingroup Server
+ * @brief   Routines for serving simulation jobs on warm state
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <iterator>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "fileio.h"
+
+langevin_table_cache::langevin_table_cache(size_t capacity)
+    : capacity(capacity)
+{
+}
+
+static bool sameTableInputs(
+    langevin_configuration const &a,
+    langevin_configuration const &b
+    )
+{
+    return a.timestep == b.timestep
+        && a.temperature == b.temperature
+        && a.damping == b.damping
+        && a.positionSpacing == b.positionSpacing
+        && a.forceVector == b.forceVector
+        && a.dampingVector == b.dampingVector;
+}
+
+/* Tables of the entry for table and conf, empty if there is none; called locked */
+std::shared_ptr<const void> langevin_table_cache::find(
+    uint64_t hash,
+    std::type_index table,
+    langevin_configuration const &conf)
+{
+    auto range = entries.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second->table == table
+            && sameTableInputs(it->second->inputs, conf)) {
+            return it->second->tables;
+        }
+    }
+    return std::shared_ptr<const void>();
+}
+
+std::shared_ptr<const void> langevin_table_cache::lookup(
+    langevin_configuration const &conf,
+    std::type_index table,
+    table_builder build,
+    bool &hit)
+{
+    uint64_t hash = hashTableInputs(conf);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<const void> cached = find(hash, table, conf);
+        if (cached) {
+            hit = true;
+            return cached;
+        }
+    }
+
+    // Build outside the lock, a concurrent miss on the same key only costs time
+    std::shared_ptr<const void> tables = build(conf);
+    hit = false;
+
+    entry e = {hash, table, langevin_configuration(), tables};
+    e.inputs.timestep = conf.timestep;
+    e.inputs.temperature = conf.temperature;
+    e.inputs.damping = conf.damping;
+    e.inputs.positionSpacing = conf.positionSpacing;
+    e.inputs.forceVector = conf.forceVector;
+    e.inputs.dampingVector = conf.dampingVector;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const void> raced = find(hash, table, conf);
+    if (raced) {
+        return raced;
+    }
+    if (order.size() >= capacity && !order.empty()) {
+        entry_iterator oldest = order.begin();
+        auto range = entries.equal_range(oldest->hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == oldest) {
+                entries.erase(it);
+                break;
+            }
+        }
+        order.pop_front();
+    }
+    order.push_back(e);
+    entries.insert(std::make_pair(hash, std::prev(order.end())));
+
+    return tables;
+}
+
+size_t langevin_table_cache::size()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return order.size();
+}
+
+/* 64-bit FNV-1a */
+static void hashBytes(
+    uint64_t &hash,
+    const void *data,
+    size_t size
+    )
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+uint64_t hashTableInputs(
+    langevin_configuration const &conf
+    )
+{
+    uint64_t hash = 14695981039346656037ULL;
+    hashBytes(hash, &conf.timestep, sizeof(conf.timestep));
+    hashBytes(hash, &conf.temperature, sizeof(conf.temperature));
+    hashBytes(hash, &conf.damping, sizeof(conf.damping));
+    hashBytes(hash, &conf.positionSpacing, sizeof(conf.positionSpacing));
+    hashBytes(hash, conf.forceVector.data(),
+              conf.forceVector.size()*sizeof(float));
+    hashBytes(hash, conf.dampingVector.data(),
+              conf.dampingVector.size()*sizeof(float));
+    return hash;
+}
+
+langevin_thread_pool::langevin_thread_pool(unsigned int threads)
+    : busy(0), stopping(false)
+{
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&langevin_thread_pool::run, this));
+    }
+}
+
+langevin_thread_pool::~langevin_thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void langevin_thread_pool::submit(std::function<void()> const &task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(task);
+    }
+    available.notify_one();
+}
+
+void langevin_thread_pool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!tasks.empty() || busy > 0) {
+        idle.wait(lock);
+    }
+}
+
+size_t langevin_thread_pool::threads() const
+{
+    return workers.size();
+}
+
+void langevin_thread_pool::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        while (tasks.empty() && !stopping) {
+            available.wait(lock);
+        }
+        if (tasks.empty()) {
+            return;
+        }
+        std::function<void()> task = tasks.front();
+        tasks.pop();
+        busy++;
+        lock.unlock();
+        task();
+        lock.lock();
+        busy--;
+        if (tasks.empty() && busy == 0) {
+            idle.notify_all();
+        }
+    }
+}
+
+/* Runs a validated job with the tables and walkers of a policy */
+struct job_runner {
+    langevin_table_cache &cache;
+    langevin_configuration const &conf;
+    std::string const &id;
+    std::ostringstream &out;
+
+    template <class Precision>
+    int run()
+    {
+        bool hit = false;
+        auto tables = cache.get<typename Precision::table_type>(conf, hit);
+        out << "result " << id << " " << SPBD_SUCCESS << " "
+            << (hit ? "cached" : "computed") << "\n";
+
+        if (conf.walkers > 0) {
+            langevin_ensemble_output ensemble;
+            resetLangevinEnsemble(ensemble, tables->bins());
+            langevin_ensemble_accumulator control(conf, ensemble);
+            ensemble.stopReason = runLangevinEnsemble<Precision>(
+                conf, *tables, 0, conf.walkers, control);
+            writeEvents(out, conf.timestep, conf.walkers, ensemble);
+            writeHistogram(out, conf.positionSpacing, ensemble);
+        } else {
+            langevin_output trajectory;
+            langevin_trajectory_recorder recorder(trajectory);
+            runLangevinTrajectory<Precision>(conf, *tables, recorder);
+            writeTrajectory(out, trajectory.positionVector,
+                            trajectory.timeVector,
+                            langevinPositionDigits(conf.precision));
+        }
+        return SPBD_SUCCESS;
+    }
+};
+
+/* Response of a job that produced no output */
+static std::string jobError(
+    std::string const &id,
+    int status
+    )
+{
+    std::ostringstream out;
+    out << "result " << id << " " << status << " none\n";
+    out << "end " << id << "\n";
+    return out.str();
+}
+
+std::string runLangevinJob(
+    langevin_table_cache &cache,
+    std::string const &id,
+    std::vector<std::string> const &lines
+    )
+{
+    std::ostringstream out;
+    langevin_configuration conf = langevin_configuration();
+    conf.name = "job " + id;
+
+    int status = parseConfiguration(lines, conf);
+    if (status == SPBD_SUCCESS) {
+        status = validateLangevinConfiguration(conf);
+    }
+    if (status != SPBD_SUCCESS) {
+        return jobError(id, status);
+    }
+
+    // A job that throws, e.g. on running out of memory, fails on its own
+    try {
+        job_runner runner = {cache, conf, id, out};
+        dispatchLangevinPrecision(conf.precision, runner);
+    } catch (std::exception const &) {
+        return jobError(id, SPBD_ERROR_JOB);
+    }
+
+    out << "end " << id << "\n";
+    return out.str();
+}
+
+/* Protocol state of one input stream */
+enum {
+    READER_NONE = 0,
+    READER_JOB  = 1,
+    READER_QUIT = 2
+};
+
+struct job_reader {
+    bool inJob;
+    std::string id;
+    std::vector<std::string> lines;
+
+    job_reader() : inJob(false) {}
+
+    /* Returns READER_JOB once a job is complete in id and lines */
+    int feed(std::string line)
+    {
+        if (!line.empty() && line[line.size()-1] == '\r') {
+            line.erase(line.size()-1);
+        }
+        if (!inJob) {
+            if (line == "quit") {
+                return READER_QUIT;
+            }
+            if (line.compare(0, 4, "job ") == 0) {
+                inJob = true;
+                id = line.substr(4);
+                lines.clear();
+            }
+            return READER_NONE;
+        }
+        if (line == "end") {
+            inJob = false;
+            return READER_JOB;
+        }
+        lines.push_back(line);
+        return READER_NONE;
+    }
+};
+
+int runStdioServer(
+    unsigned int threads
+    )
+{
+    langevin_table_cache cache;
+    langevin_thread_pool pool(threads);
+    std::mutex outputMutex;
+    job_reader reader;
+    std::string line;
+
+    while (std::getline(std::cin, line)) {
+        int state = reader.feed(line);
+        if (state == READER_QUIT) {
+            break;
+        }
+        if (state == READER_JOB) {
+            std::string id = reader.id;
+            std::vector<std::string> lines = reader.lines;
+            pool.submit([&cache, &outputMutex, id, lines]() {
+                std::string result = runLangevinJob(cache, id, lines);
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cout << result << std::flush;
+            });
+        }
+    }
+    pool.wait();
+    return 0;
+}
+
+/* A client connection, closed once the reader and all its jobs are done */
+struct server_connection {
+    int fd;
+    std::mutex mutex;
+
+    explicit server_connection(int fd) : fd(fd) {}
+    ~server_connection() { close(fd); }
+
+    void send(std::string const &text)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t sent = 0;
+        while (sent < text.size()) {
+            ssize_t n = ::send(fd, text.data() + sent, text.size() - sent,
+                               MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return;
+            }
+            sent += n;
+        }
+    }
+};
+
+/* Shared state of the socket server */
+struct socket_server {
+    langevin_table_cache cache;
+    langevin_thread_pool pool;
+    int listenFd;
+    std::atomic<bool> quit;
+    std::mutex mutex;
+    std::vector<std::weak_ptr<server_connection> > connections;
+
+    explicit socket_server(unsigned int threads)
+        : pool(threads), listenFd(-1), quit(false) {}
+
+    /* Stops accepting and ends the reads of every open connection */
+    void stop()
+    {
+        quit.store(true);
+        shutdown(listenFd, SHUT_RDWR);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < connections.size(); i++) {
+            std::shared_ptr<server_connection> c = connections[i].lock();
+            if (c) {
+                shutdown(c->fd, SHUT_RD);
+            }
+        }
+    }
+};
+
+static void serveConnection(
+    std::shared_ptr<server_connection> connection,
+    socket_server *server
+    )
+{
+    job_reader reader;
+    std::string pending;
+    char buffer[65536];
+
+    while (true) {
+        ssize_t n = recv(connection->fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        pending.append(buffer, n);
+
+        size_t start = 0;
+        size_t newline = 0;
+        while ((newline = pending.find('\n', start)) != std::string::npos) {
+            int state = reader.feed(pending.substr(start, newline - start));
+            start = newline + 1;
+            if (state == READER_QUIT) {
+                server->stop();
+                return;
+            }
+            if (state == READER_JOB) {
+                std::string id = reader.id;
+                std::vector<std::string> lines = reader.lines;
+                langevin_table_cache *cache = &server->cache;
+                server->pool.submit([connection, cache, id, lines]() {
+                    connection->send(runLangevinJob(*cache, id, lines));
+                });
+            }
+        }
+        pending.erase(0, start);
+    }
+}
+
+int runSocketServer(
+    std::string const &path,
+    unsigned int threads
+    )
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cout << "Socket path too long: " << path << "\n";
+        return -1;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    socket_server server(threads);
+    server.listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listenFd < 0) {
+        std::cout << "Could not create socket: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+    unlink(path.c_str());
+    if (bind(server.listenFd, (sockaddr*)&address, sizeof(address)) != 0
+        || listen(server.listenFd, 16) != 0) {
+        std::cout << "Could not listen on " << path << ": "
+                  << std::strerror(errno) << "\n";
+        close(server.listenFd);
+        return -1;
+    }
+
+    std::cout << "Serving jobs on " << path << " with "
+              << server.pool.threads() << " threads.\n" << std::flush;
+
+    // One reader per connection, the finished ones are joined on every accept
+    std::list<std::future<void> > readers;
+    while (!server.quit.load()) {
+        int fd = accept(server.listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR && !server.quit.load()) {
+                continue;
+            }
+            break;
+        }
+        std::shared_ptr<server_connection> connection(new server_connection(fd));
+        {
+            std::lock_guard<std::mutex> lock(server.mutex);
+            for (size_t i = server.connections.size(); i-- > 0; ) {
+                if (server.connections[i].expired()) {
+                    server.connections.erase(server.connections.begin() + i);
+                }
+            }
+            server.connections.push_back(connection);
+        }
+        for (auto it = readers.begin(); it != readers.end(); ) {
+            if (it->wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                it = readers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        readers.push_back(std::async(std::launch::async, serveConnection,
+                                     connection, &server));
+    }
+
+    for (auto it = readers.begin(); it != readers.end(); ++it) {
+        it->wait();
+    }
+    server.pool.wait();
+    close(server.listenFd);
+    unlink(path.c_str());
+    return 0;
+}
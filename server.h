@@ -0,0 +1,201 @@
+/**
+ * @defgroup  Server  Job server
+ * @brief     Long-running server that runs simulation jobs on warm state
+*/
+/**
+ * @file    server.h
+ * @ingroup Server
+ * @brief   Contains declarations for the job server, its thread pool and
+ *          its step table cache
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#ifndef _LANGEVINSERVER_H_
+#define _LANGEVINSERVER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include "langevin.h"
+
+/*
+ * Job protocol, line based, on stdin/stdout or a Unix domain socket:
+ *
+ *   job <id>                        result <id> <status> <tables>
+ *   <configuration lines>    -->    <csv output lines>
+ *   end                             end <id>
+ *
+ * <status> is 0 or an SPBD_ERROR code, <tables> is "cached" or "computed".
+ * A job that fails answers with tables "none" and no output; besides the
+ * validation errors that is SPBD_ERROR_PARSE for a malformed number and
+ * SPBD_ERROR_JOB for a job that threw while running.
+ * Results are sent as soon as each job finishes, not in submission order.
+ * A line "quit" stops the server once the running jobs are done.
+ */
+
+/* Step tables kept for at most this many distinct inputs and table types */
+#define SPBD_TABLE_CACHE_SIZE 256
+
+/**
+ * @brief   Cache of step size tables, keyed by the inputs they depend on
+ * @ingroup Server
+ * @author  Kherim Willems
+ *
+ * Tables of every table type (float, double and compact) share the cache,
+ * keyed by their type and the inputs they are built from. Lookups hash the
+ * inputs and compare them in full on a hash match, so a collision never
+ * returns wrong tables. The oldest entry is evicted once the cache is
+ * full. Tables are built outside the lock; when two misses on the same
+ * key race, the second keeps the tables of the first.
+ */
+class langevin_table_cache {
+public:
+    explicit langevin_table_cache(size_t capacity = SPBD_TABLE_CACHE_SIZE);
+
+    /* Returns the tables of type Table for conf, building them on a miss */
+    template <class Table>
+    std::shared_ptr<const langevin_tables_of<Table> > get(
+        langevin_configuration const &conf, bool &hit)
+    {
+        return std::static_pointer_cast<const langevin_tables_of<Table> >(
+            lookup(conf, typeid(Table), &buildTables<Table>, hit));
+    }
+    size_t size();
+
+private:
+    typedef std::shared_ptr<const void> (*table_builder)(
+        langevin_configuration const &conf);
+
+    template <class Table>
+    static std::shared_ptr<const void> buildTables(
+        langevin_configuration const &conf)
+    {
+        std::shared_ptr<langevin_tables_of<Table> > tables(
+            new langevin_tables_of<Table>);
+        buildLangevinTables(conf, *tables);
+        return tables;
+    }
+
+    struct entry {
+        uint64_t hash;
+        std::type_index table;
+        langevin_configuration inputs;
+        std::shared_ptr<const void> tables;
+    };
+    typedef std::list<entry>::iterator entry_iterator;
+
+    std::shared_ptr<const void> lookup(
+        langevin_configuration const &conf, std::type_index table,
+        table_builder build, bool &hit);
+    std::shared_ptr<const void> find(
+        uint64_t hash, std::type_index table, langevin_configuration const &conf);
+
+    std::mutex mutex;
+    size_t capacity;
+    /* Entries oldest first, indexed by the hash of their inputs */
+    std::list<entry> order;
+    std::unordered_multimap<uint64_t, entry_iterator> entries;
+};
+
+/**
+ * @brief   Hashes the inputs of the step size tables of a configuration
+ * @ingroup Server
+ * @author  Kherim Willems
+ */
+uint64_t hashTableInputs(
+    langevin_configuration const &conf
+    );
+
+/**
+ * @brief   Fixed set of worker threads running queued tasks
+ * @ingroup Server
+ * @author  Kherim Willems
+ */
+class langevin_thread_pool {
+public:
+    explicit langevin_thread_pool(unsigned int threads);
+    /* Finishes all queued tasks, then joins the workers */
+    ~langevin_thread_pool();
+
+    void submit(std::function<void()> const &task);
+    /* Blocks until the queue is empty and every worker is idle */
+    void wait();
+    size_t threads() const;
+
+private:
+    void run();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable available;
+    std::condition_variable idle;
+    unsigned int busy;
+    bool stopping;
+};
+
+/**
+ * @brief   Runs one job on cached tables
+ * @ingroup Server
+ * @author  Kherim Willems
+ * @param   cache   Step table cache
+ * @param   id      Job id, echoed in the response
+ * @param   lines   Configuration lines of the job
+ * @returns Complete response, from the result line to the end line
+ *
+ * Jobs with walkers > 0 answer with the event summary followed by the
+ * histogram, other jobs with the trajectory. Output file keys, processes
+ * and pipeline stages of the configuration are ignored.
+ */
+std::string runLangevinJob(
+    langevin_table_cache &cache,
+    std::string const &id,
+    std::vector<std::string> const &lines
+    );
+
+/**
+ * @brief   Serves jobs from stdin, writing results to stdout
+ * @ingroup Server
+ * @author  Kherim Willems
+ * @param   threads     Number of pool threads
+ * @returns 0 on success
+ */
+int runStdioServer(
+    unsigned int threads
+    );
+
+/**
+ * @brief   Serves jobs on a Unix domain socket until a client sends quit
+ * @ingroup Server
+ * @author  Kherim Willems
+ * @param   path        Socket path, replaced if it exists
+ * @param   threads     Number of pool threads
+ * @returns 0 on success, -1 if the socket could not be set up
+ */
+int runSocketServer(
+    std::string const &path,
+    unsigned int threads
+    );
+
+#endif
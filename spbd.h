@@ -0,0 +1,1411 @@
+/**
+ * @defgroup  Library  SPBD library
+ * @brief     Header-only Langevin engine for embedding spbd in other programs
+*/
+/**
+ * @file    spbd.h
+ * @ingroup Library
+ * @brief   Header-only simulation library with compile-time observer hooks
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * The library never writes to stdout or stderr. Everything a caller wants
+ * to see while a simulation runs is delivered through an observer type
+ * given as template parameter. Observers derive from langevin_observer and
+ * switch hooks on through its static flags; hooks that stay off are
+ * removed at compile time.
+ *
+ * The scalar types of the step tables, the noise and the position
+ * accumulator are chosen through a precision policy (langevin_precision).
+ * Functions default to all-float, the original behaviour, and the
+ * precision key of a configuration selects a policy at run time.
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#ifndef _SPBD_H_
+#define _SPBD_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#define SPBD_VERSION "0.2.0"
+
+/* Software prefetch of table lookups, define SPBD_NO_PREFETCH to disable */
+#if defined(__GNUC__) && !defined(SPBD_NO_PREFETCH)
+#define SPBD_PREFETCH(address) __builtin_prefetch(address)
+#else
+#define SPBD_PREFETCH(address) ((void)(address))
+#endif
+
+/* Status codes returned by the library */
+enum {
+    SPBD_SUCCESS          =  0,
+    SPBD_ERROR_FORCE      = -1,
+    SPBD_ERROR_DAMPING    = -2,
+    SPBD_ERROR_SPACING    = -3,
+    SPBD_ERROR_SAVEFREQ   = -4,
+    SPBD_ERROR_TIMESTEP   = -5,
+    SPBD_ERROR_PRECISION  = -6,
+    SPBD_ERROR_PARSE      = -7,
+    SPBD_ERROR_JOB        = -8
+};
+
+/* Reasons for a run to end, checked at block boundaries */
+enum {
+    SPBD_RUNNING          =  0,
+    SPBD_STOP_STEPS       =  1,
+    SPBD_STOP_CONVERGED   =  2,
+    SPBD_STOP_EVENTS      =  3,
+    SPBD_STOP_WALLCLOCK   =  4
+};
+
+/* Precision policies selectable with the precision key */
+enum {
+    SPBD_PRECISION_FLOAT       = 0,
+    SPBD_PRECISION_MIXED       = 1,
+    SPBD_PRECISION_COMPENSATED = 2,
+    SPBD_PRECISION_DOUBLE      = 3,
+    SPBD_PRECISION_COMPACT     = 4
+};
+
+/* Fewest full blocks after equilibration before the histogram error is trusted */
+#define SPBD_MIN_BLOCKS 10
+
+struct langevin_configuration {
+    std::string name;
+    unsigned long long steps;
+    unsigned long long saveFreq;
+    float timestep;
+    float temperature;
+    float damping;
+    float positionStart;
+    float positionSpacing;
+    std::vector<float> forceVector;
+    std::vector<float> dampingVector;
+    int method;
+    std::string trajectoryOutputFile;
+    unsigned long long walkers = 0;
+    unsigned long long processes = 1;
+    unsigned long long seed = 0;
+    float eventPosition = NAN;
+    std::string histogramOutputFile;
+    std::string eventOutputFile;
+    std::vector<std::string> pipelineStages;
+    bool pipelineBackpressure = false;
+    unsigned long long pipelineRingSize = 64;
+    unsigned long long correlationLags = 100;
+    std::string correlationOutputFile;
+    unsigned long long blockSteps = 0;
+    unsigned long long equilibrationSteps = 0;
+    double targetRelativeError = 0.0;
+    unsigned long long targetEvents = 0;
+    double wallClockLimit = 0.0;
+    int precision = SPBD_PRECISION_FLOAT;
+};
+
+/* Positions are kept in double, so double-position policies keep theirs */
+struct langevin_output {
+    std::vector<double> positionVector;
+    std::vector<unsigned long long> timeVector;
+};
+
+/*
+ * Ensemble results. Samples of the first conf.equilibrationSteps steps of
+ * every walker are left out. Every full-length block that starts after
+ * the equilibration is one batch, its bin counts summed over all walkers;
+ * the squared per-batch bin counts give the block-averaging error
+ * estimate. The walkers of a block share their start, so they are not
+ * batches of their own. Other blocks, such as a shorter final one, add to
+ * the histogram but not to the batches, their squares or batchSamples.
+ */
+struct langevin_ensemble_output {
+    std::vector<unsigned long long> histogram;
+    std::vector<unsigned long long> histogramSquares;
+    unsigned long long samples = 0;
+    unsigned long long batches = 0;
+    unsigned long long batchSamples = 0;
+    unsigned long long walkerSteps = 0;
+    unsigned long long events = 0;
+    unsigned long long eventSteps = 0;
+    double eventStepSquares = 0.0;
+    int stopReason = SPBD_RUNNING;
+};
+
+struct langevin_simulation {
+    langevin_configuration conf;
+    langevin_output out;
+    langevin_ensemble_output ensemble;
+};
+
+/**
+ * @brief   Scalar types used by the engine
+ * @ingroup Library
+ * @author  Kherim Willems
+ *
+ * Table is the type of the step size tables, Noise the type of the normal
+ * deviates and Position the type the position is accumulated in. With
+ * Compensated set, every step is added with Kahan summation, which keeps
+ * the rounding error of a float position from building up into a drift.
+ */
+template <class Table, class Noise, class Position, bool Compensated = false>
+struct langevin_precision {
+    typedef Table table_type;
+    typedef Noise noise_type;
+    typedef Position position_type;
+    static const bool compensated = Compensated;
+};
+
+/* All float, the original engine */
+typedef langevin_precision<float, float, float> langevin_precision_float;
+/* Float tables and noise, double position */
+typedef langevin_precision<float, float, double> langevin_precision_mixed;
+/* All float, Kahan-compensated position */
+typedef langevin_precision<float, float, float, true>
+    langevin_precision_compensated;
+/* All double */
+typedef langevin_precision<double, double, double> langevin_precision_double;
+
+/* Table type of compact tables, see langevin_tables_of<langevin_half> */
+struct langevin_half {};
+
+/* Compact fp16 tables, float noise, double position */
+typedef langevin_precision<langevin_half, float, double>
+    langevin_precision_compact;
+
+/* Precomputed step sizes per grid point and the grid bounds */
+template <class Table>
+struct langevin_tables_of {
+    typedef Table value_type;
+
+    std::vector<Table> external;
+    std::vector<Table> thermal;
+    Table positionSpacing;
+    Table minPos;
+    Table maxPos;
+    unsigned long minIndex;
+    unsigned long maxIndex;
+
+    unsigned long bins() const { return external.size(); }
+};
+
+typedef langevin_tables_of<float> langevin_tables;
+
+/* Both step sizes of one grid point as fp16 bit patterns */
+struct langevin_half_step {
+    uint16_t external;
+    uint16_t thermal;
+};
+
+/*
+ * Compact tables for very fine grids. The two step sizes of a grid point
+ * are stored next to each other as fp16, half the size of the float
+ * tables, so every lookup touches a single cache line. Each table is
+ * scaled by a power of two before encoding so its largest value sits at
+ * the top of the fp16 range; the factors undo the scale when decoding.
+ */
+template <>
+struct langevin_tables_of<langevin_half> {
+    typedef float value_type;
+
+    std::vector<langevin_half_step> steps;
+    float externalFactor;
+    float thermalFactor;
+    float positionSpacing;
+    float minPos;
+    float maxPos;
+    unsigned long minIndex;
+    unsigned long maxIndex;
+
+    unsigned long bins() const { return steps.size(); }
+};
+
+typedef langevin_tables_of<langevin_half> langevin_compact_tables;
+
+/* Grid of the float tables without the tables, for binning positions */
+struct langevin_grid {
+    float positionSpacing;
+    float minPos;
+    float maxPos;
+    unsigned long minIndex;
+    unsigned long maxIndex;
+};
+
+/* State of a single walker: position and its own random stream */
+template <class Precision>
+struct langevin_walker_of {
+    typename Precision::position_type position;
+    /* Running Kahan compensation, zero unless Precision::compensated */
+    typename Precision::position_type compensation;
+    std::default_random_engine generator;
+    std::normal_distribution<typename Precision::noise_type> distribution;
+
+    langevin_walker_of()
+        : position(0.0), compensation(0.0), distribution(0.0,1.0) {}
+};
+
+typedef langevin_walker_of<langevin_precision_float> langevin_walker;
+
+/**
+ * @brief   Base of all observers, every hook is off and empty
+ * @ingroup Library
+ * @author  Kherim Willems
+ *
+ * Derived observers redeclare the flag of each hook they use as true and
+ * hide the matching member function. Positions arrive in the position_type
+ * of the precision policy, so observers that take them as a template
+ * parameter (or as double) see every bit the policy accumulates.
+ */
+struct langevin_observer {
+    /* onStep(walker, step, position) after every step */
+    static const bool observeSteps = false;
+    /* onSample(walker, step, position) every saveFreq steps */
+    static const bool observeSamples = false;
+    /* onProgress(step, steps) twenty times per trajectory */
+    static const bool observeProgress = false;
+
+    template <class Position>
+    void onStep(unsigned long long, unsigned long long, Position) {}
+    template <class Position>
+    void onSample(unsigned long long, unsigned long long, Position) {}
+    void onProgress(unsigned long long, unsigned long long) {}
+};
+
+/**
+ * @brief   Forwards every hook to two observers
+ * @ingroup Library
+ * @author  Kherim Willems
+ */
+template <class First, class Second>
+struct langevin_observer_pair {
+    static const bool observeSteps =
+        First::observeSteps || Second::observeSteps;
+    static const bool observeSamples =
+        First::observeSamples || Second::observeSamples;
+    static const bool observeProgress =
+        First::observeProgress || Second::observeProgress;
+
+    First &first;
+    Second &second;
+
+    langevin_observer_pair(First &first, Second &second)
+        : first(first), second(second) {}
+
+    template <class Position>
+    void onStep(unsigned long long walker, unsigned long long step, Position pos)
+    {
+        if (First::observeSteps) first.onStep(walker, step, pos);
+        if (Second::observeSteps) second.onStep(walker, step, pos);
+    }
+    template <class Position>
+    void onSample(unsigned long long walker, unsigned long long step, Position pos)
+    {
+        if (First::observeSamples) first.onSample(walker, step, pos);
+        if (Second::observeSamples) second.onSample(walker, step, pos);
+    }
+    void onProgress(unsigned long long step, unsigned long long steps)
+    {
+        if (First::observeProgress) first.onProgress(step, steps);
+        if (Second::observeProgress) second.onProgress(step, steps);
+    }
+};
+
+/**
+ * @brief   Records the samples of a single trajectory in a langevin_output
+ * @ingroup Library
+ * @author  Kherim Willems
+ */
+struct langevin_trajectory_recorder : langevin_observer {
+    static const bool observeSamples = true;
+
+    langevin_output &out;
+
+    explicit langevin_trajectory_recorder(langevin_output &out)
+        : out(out) {}
+
+    template <class Position>
+    void onSample(unsigned long long, unsigned long long step, Position pos)
+    {
+        out.positionVector.push_back(pos);
+        out.timeVector.push_back(step);
+    }
+};
+
+/**
+ * @brief   Compute external force langevin step size vector
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   timestep        Size of the integration timestep [ns]
+ * @param   damping         Damping constant of particle [pN*ns/nm]
+ * @param   forceVector     Vector containing the force distribution [pN]
+ * @param   dampingVector   Vector containing the distribution of relative damping constants at each position [1]
+ * @param   externalVector  Output vector containing thermal step [nm]
+ * @returns 0 on success
+ */
+template <class T>
+inline int calcExternalStepVector(
+    T timestep,
+    T damping,
+    std::vector<float> const &forceVector,
+    std::vector<float> const &dampingVector,
+    std::vector<T> &externalVector)
+{
+    T forceV = 0.0;
+    T dampingV = 0.0;
+    T externalV = 0.0;
+
+    for (unsigned int i = 0; i < externalVector.size(); i++) {
+        forceV = forceVector[i];
+        dampingV = dampingVector[i];
+        externalV = (forceV*timestep)/(damping*dampingV);
+        externalVector[i] = externalV;
+    }
+    return 0;
+}
+
+/**
+ * @brief   Compute thermal force langevin step size vector
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   timestep        Size of the integration timestep [ns]
+ * @param   temperature     Temperature of the simulation kB*T [pN*nm]
+ * @param   damping         Damping constant of particle [pN*ns/nm]
+ * @param   dampingVector   Vector containing the distribution of relative damping constants at each position [1]
+ * @param   thermalVector   Output vector containing thermal step [nm]
+ * @returns 0 on success
+ */
+template <class T>
+inline int calcThermalStepVector(
+    T timestep,
+    T temperature,
+    T damping,
+    std::vector<float> const &dampingVector,
+    std::vector<T> &thermalVector)
+{
+    T dampingV = 0.0;
+    T thermalV = 0.0;
+
+    for (unsigned int i = 0; i < thermalVector.size(); i++) {
+        dampingV = dampingVector[i];
+        thermalV = std::sqrt((2*temperature*timestep)/(damping*dampingV));
+        thermalVector[i] = thermalV;
+    }
+    return 0;
+}
+
+/**
+ * @brief   Checks that a configuration can be simulated
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   conf    Configuration to check
+ * @returns SPBD_SUCCESS or one of the SPBD_ERROR codes
+ */
+inline int validateLangevinConfiguration(
+    langevin_configuration const &conf
+    )
+{
+    if (conf.forceVector.empty()) {
+        return SPBD_ERROR_FORCE;
+    }
+    if (conf.dampingVector.size() < conf.forceVector.size()) {
+        return SPBD_ERROR_DAMPING;
+    }
+    if (!(conf.positionSpacing > 0.0)) {
+        return SPBD_ERROR_SPACING;
+    }
+    if (conf.saveFreq == 0) {
+        return SPBD_ERROR_SAVEFREQ;
+    }
+    if (!(conf.timestep > 0.0)) {
+        return SPBD_ERROR_TIMESTEP;
+    }
+    if (conf.precision < SPBD_PRECISION_FLOAT
+        || conf.precision > SPBD_PRECISION_COMPACT) {
+        return SPBD_ERROR_PRECISION;
+    }
+    return SPBD_SUCCESS;
+}
+
+/**
+ * @brief   Describes a status code returned by the library
+ * @ingroup Library
+ * @author  Kherim Willems
+ */
+inline const char *langevinErrorString(
+    int status
+    )
+{
+    switch (status) {
+    case SPBD_SUCCESS:        return "success";
+    case SPBD_ERROR_FORCE:    return "forceVector is empty";
+    case SPBD_ERROR_DAMPING:  return "dampingVector is shorter than forceVector";
+    case SPBD_ERROR_SPACING:  return "positionSpacing must be positive";
+    case SPBD_ERROR_SAVEFREQ: return "saveFreq must be positive";
+    case SPBD_ERROR_TIMESTEP: return "timestep must be positive";
+    case SPBD_ERROR_PRECISION: return "precision is unknown";
+    case SPBD_ERROR_PARSE:    return "configuration value is not a valid number";
+    case SPBD_ERROR_JOB:      return "job failed while running";
+    }
+    return "unknown error";
+}
+
+/**
+ * @brief   Names of the precision policies, as used by the precision key
+ * @ingroup Library
+ * @author  Kherim Willems
+ */
+inline const char *langevinPrecisionString(
+    int precision
+    )
+{
+    switch (precision) {
+    case SPBD_PRECISION_FLOAT:       return "float";
+    case SPBD_PRECISION_MIXED:       return "mixed";
+    case SPBD_PRECISION_COMPENSATED: return "compensated";
+    case SPBD_PRECISION_DOUBLE:      return "double";
+    case SPBD_PRECISION_COMPACT:     return "compact";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief   Significant digits that write the positions of a policy in full
+ * @ingroup Library
+ * @author  Kherim Willems
+ *
+ * Policies with float positions keep the stream default of six digits, so
+ * their output files do not change; double positions get fifteen.
+ */
+inline int langevinPositionDigits(
+    int precision
+    )
+{
+    switch (precision) {
+    case SPBD_PRECISION_MIXED:
+    case SPBD_PRECISION_DOUBLE:
+    case SPBD_PRECISION_COMPACT:
+        return 15;
+    }
+    return 6;
+}
+
+/**
+ * @brief   Looks up a precision policy by name
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @returns One of the SPBD_PRECISION values, -1 for an unknown name
+ */
+inline int langevinPrecisionFromString(
+    std::string const &name
+    )
+{
+    for (int p = SPBD_PRECISION_FLOAT; p <= SPBD_PRECISION_COMPACT; p++) {
+        if (name == langevinPrecisionString(p)) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief   Calls runner.run<Precision>() with the policy of a precision value
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   precision   One of the SPBD_PRECISION values
+ * @param   runner      Object with a member template run<Precision>()
+ * @returns The result of run
+ *
+ * This is how code that is written once for all policies picks one from a
+ * configuration at run time. Unknown values run with float.
+ */
+template <class Runner>
+inline int dispatchLangevinPrecision(
+    int precision,
+    Runner &runner
+    )
+{
+    switch (precision) {
+    case SPBD_PRECISION_MIXED:
+        return runner.template run<langevin_precision_mixed>();
+    case SPBD_PRECISION_COMPENSATED:
+        return runner.template run<langevin_precision_compensated>();
+    case SPBD_PRECISION_DOUBLE:
+        return runner.template run<langevin_precision_double>();
+    case SPBD_PRECISION_COMPACT:
+        return runner.template run<langevin_precision_compact>();
+    }
+    return runner.template run<langevin_precision_float>();
+}
+
+/* Sets the spacing and bounds of a grid of bins points */
+template <class Grid>
+inline void setLangevinGrid(
+    float positionSpacing,
+    unsigned long bins,
+    Grid &grid
+    )
+{
+    grid.positionSpacing = positionSpacing;
+    grid.minPos = 0.0;
+    grid.maxPos = (bins-1)*grid.positionSpacing;
+    grid.minIndex = long(grid.minPos/grid.positionSpacing);
+    grid.maxIndex = long(grid.maxPos/grid.positionSpacing);
+}
+
+/* Sets the grid spacing and bounds of tables */
+template <class Tables>
+inline void setLangevinGrid(
+    langevin_configuration const &conf,
+    Tables &tables
+    )
+{
+    setLangevinGrid(conf.positionSpacing, conf.forceVector.size(), tables);
+}
+
+/**
+ * @brief   Pre-computes the step size tables of a configuration
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   conf    Simulation configuration
+ * @param   tables  Output tables
+ * @returns 0 on success
+ */
+template <class Table>
+inline int buildLangevinTables(
+    langevin_configuration const &conf,
+    langevin_tables_of<Table> &tables
+    )
+{
+    tables.external.resize(conf.forceVector.size());
+    tables.thermal.resize(conf.forceVector.size());
+
+    // F/gamma
+    calcExternalStepVector<Table>(conf.timestep, conf.damping,
+        conf.forceVector, conf.dampingVector, tables.external);
+    // (2*kB*T*Dt/gamma)^0.5
+    calcThermalStepVector<Table>(conf.timestep, conf.temperature,
+        conf.damping, conf.dampingVector, tables.thermal);
+
+    setLangevinGrid(conf, tables);
+    return 0;
+}
+
+/**
+ * @brief   Encodes a value as fp16, rounding to nearest even
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   value   Value below 65504 in magnitude
+ * @returns fp16 bit pattern
+ */
+inline uint16_t langevinEncodeHalf(
+    double value
+    )
+{
+    uint16_t sign = value < 0.0 ? 0x8000 : 0;
+    double magnitude = std::fabs(value);
+    if (magnitude < std::ldexp(1.0, -14)) {
+        // Subnormal, in units of 2^-24; 1024 rounds up to the smallest normal
+        return sign | (uint16_t)std::nearbyint(std::ldexp(magnitude, 24));
+    }
+    int exponent;
+    double mantissa = std::frexp(magnitude, &exponent);
+    // A mantissa rounded up to 1024 carries into the exponent bits
+    return sign | (uint16_t)(((exponent + 14) << 10)
+        + (int)std::nearbyint((2.0*mantissa - 1.0)*1024));
+}
+
+/**
+ * @brief   Decodes an fp16 bit pattern and multiplies it by factor/2^112
+ * @ingroup Library
+ * @author  Kherim Willems
+ *
+ * Moving the fp16 exponent and mantissa into a float as they are gives the
+ * value times 2^-112, also for subnormals. The factor of compact tables
+ * includes the 2^112, so decoding costs a shift and a multiplication.
+ */
+inline float langevinDecodeHalf(
+    uint16_t bits,
+    float factor
+    )
+{
+    uint32_t word = ((uint32_t)(bits & 0x8000) << 16)
+                  | ((uint32_t)(bits & 0x7fff) << 13);
+    float value;
+    std::memcpy(&value, &word, sizeof(value));
+    return value*factor;
+}
+
+/* Power of two that brings the largest value of a table just below 2^15 */
+inline int langevinHalfScale(
+    std::vector<float> const &values
+    )
+{
+    float largest = 0.0;
+    for (unsigned long i = 0; i < values.size(); i++) {
+        largest = std::max(largest, std::fabs(values[i]));
+    }
+    if (!(largest > 0.0) || std::isinf(largest)) {
+        return 0;
+    }
+    int exponent;
+    std::frexp(largest, &exponent);
+    return 15 - exponent;
+}
+
+/**
+ * @brief   Pre-computes compact tables of a configuration
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   conf    Simulation configuration
+ * @param   tables  Output tables
+ * @returns 0 on success
+ *
+ * The step sizes are computed in float as for the float tables, then
+ * encoded with a relative error of at most 2^-11.
+ */
+inline int buildLangevinTables(
+    langevin_configuration const &conf,
+    langevin_compact_tables &tables
+    )
+{
+    std::vector<float> external(conf.forceVector.size());
+    std::vector<float> thermal(conf.forceVector.size());
+    calcExternalStepVector<float>(conf.timestep, conf.damping,
+        conf.forceVector, conf.dampingVector, external);
+    calcThermalStepVector<float>(conf.timestep, conf.temperature,
+        conf.damping, conf.dampingVector, thermal);
+
+    int externalScale = langevinHalfScale(external);
+    int thermalScale = langevinHalfScale(thermal);
+    tables.steps.resize(conf.forceVector.size());
+    for (unsigned long i = 0; i < tables.steps.size(); i++) {
+        tables.steps[i].external =
+            langevinEncodeHalf(std::ldexp((double)external[i], externalScale));
+        tables.steps[i].thermal =
+            langevinEncodeHalf(std::ldexp((double)thermal[i], thermalScale));
+    }
+    tables.externalFactor = std::ldexp(1.0f, 112 - externalScale);
+    tables.thermalFactor = std::ldexp(1.0f, 112 - thermalScale);
+
+    setLangevinGrid(conf, tables);
+    return 0;
+}
+
+/**
+ * @brief   Step sizes at grid point i
+ * @ingroup Library
+ * @author  Kherim Willems
+ */
+template <class Table>
+inline void langevinSteps(
+    langevin_tables_of<Table> const &tables,
+    unsigned long i,
+    Table &external,
+    Table &thermal
+    )
+{
+    external = tables.external[i];
+    thermal = tables.thermal[i];
+}
+
+inline void langevinSteps(
+    langevin_compact_tables const &tables,
+    unsigned long i,
+    float &external,
+    float &thermal
+    )
+{
+    langevin_half_step step = tables.steps[i];
+    external = langevinDecodeHalf(step.external, tables.externalFactor);
+    thermal = langevinDecodeHalf(step.thermal, tables.thermalFactor);
+}
+
+/**
+ * @brief   Starts loading the step sizes of grid point i into the cache
+ * @ingroup Library
+ * @author  Kherim Willems
+ */
+template <class Table>
+inline void langevinPrefetch(
+    langevin_tables_of<Table> const &tables,
+    unsigned long i
+    )
+{
+    SPBD_PREFETCH(&tables.external[i]);
+    SPBD_PREFETCH(&tables.thermal[i]);
+}
+
+inline void langevinPrefetch(
+    langevin_compact_tables const &tables,
+    unsigned long i
+    )
+{
+    SPBD_PREFETCH(&tables.steps[i]);
+}
+
+/**
+ * @brief   Grid index for a position, clamped to the grid
+ * @ingroup Library
+ * @author  Kherim Willems
+ *
+ * Grid is a set of tables or a langevin_grid, set by setLangevinGrid().
+ */
+template <class Grid, class Position>
+inline unsigned long langevinIndex(
+    Grid const &grid,
+    Position pos
+    )
+{
+    if (pos < grid.minPos) {
+        return grid.minIndex;
+    } else if (pos > grid.maxPos) {
+        return grid.maxIndex;
+    }
+    return long(pos/grid.positionSpacing);
+}
+
+/**
+ * @brief   Places a walker at its start and seeds its own random stream
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   walker      Walker to initialize
+ * @param   position    Starting position [nm]
+ * @param   seed        Ensemble seed
+ * @param   index       Index of the walker in the ensemble
+ */
+template <class Precision>
+inline void seedLangevinWalker(
+    langevin_walker_of<Precision> &walker,
+    float position,
+    unsigned long long seed,
+    unsigned long long index
+    )
+{
+    std::seed_seq seq{
+        (unsigned long)(seed & 0xffffffff),
+        (unsigned long)(seed >> 32),
+        (unsigned long)(index & 0xffffffff),
+        (unsigned long)(index >> 32)};
+    walker.position = position;
+    walker.compensation = 0.0;
+    walker.generator.seed(seq);
+    walker.distribution.reset();
+}
+
+/**
+ * @brief   Advances a walker over the steps [firstStep, lastStep]
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   tables      Step size tables
+ * @param   walker      Walker to advance
+ * @param   index       Index of the walker, passed on to the observer
+ * @param   firstStep   Number of the first step to perform
+ * @param   lastStep    Number of the last step to perform
+ * @param   saveFreq    Sample after every 'saveFreq' step
+ * @param   observer    Observer receiving the enabled hooks
+ */
+template <class Precision, class Observer>
+inline void advanceLangevinWalker(
+    langevin_tables_of<typename Precision::table_type> const &tables,
+    langevin_walker_of<Precision> &walker,
+    unsigned long long index,
+    unsigned long long firstStep,
+    unsigned long long lastStep,
+    unsigned long long saveFreq,
+    Observer &observer
+    )
+{
+    typedef typename Precision::table_type table_type;
+    typedef typename Precision::position_type position_type;
+    typedef typename langevin_tables_of<table_type>::value_type value_type;
+
+    position_type pos = walker.position;
+    position_type compensation = walker.compensation;
+    unsigned long i = langevinIndex(tables, pos);
+
+    for (unsigned long long s = firstStep; s != lastStep+1; s++) {
+        value_type external;
+        value_type thermal;
+        langevinSteps(tables, i, external, thermal);
+        if (Precision::compensated) {
+            position_type step = external
+                + thermal*walker.distribution(walker.generator);
+            position_type corrected = step - compensation;
+            position_type sum = pos + corrected;
+            compensation = (sum - pos) - corrected;
+            pos = sum;
+        } else {
+            pos = pos + external
+                      + thermal*walker.distribution(walker.generator);
+        }
+        // Start loading the next lookup before the observers and the next
+        // random number, on fine grids it is usually a cache miss
+        i = langevinIndex(tables, pos);
+        langevinPrefetch(tables, i);
+
+        if (Observer::observeSteps) {
+            observer.onStep(index, s, pos);
+        }
+        if (Observer::observeSamples && s % saveFreq == 0) {
+            observer.onSample(index, s, pos);
+        }
+    }
+    walker.position = pos;
+    walker.compensation = compensation;
+}
+
+/**
+ * @brief   Seconds elapsed since start
+ * @ingroup Library
+ * @author  Kherim Willems
+ */
+inline double langevinElapsed(
+    std::chrono::steady_clock::time_point start
+    )
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief   Computes a single Langevin trajectory
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   conf        Simulation configuration
+ * @param   tables      Step size tables built from conf
+ * @param   observer    Observer receiving the enabled hooks
+ * @returns Number of steps performed
+ *
+ * The walker uses the default seeded random stream. The starting position
+ * is reported as the sample of step 0. With conf.wallClockLimit set the
+ * run ends at the first block boundary past the limit. The precision
+ * policy is a template argument; conf.precision is not looked at here.
+ */
+template <class Precision = langevin_precision_float, class Observer>
+inline unsigned long long runLangevinTrajectory(
+    langevin_configuration const &conf,
+    langevin_tables_of<typename Precision::table_type> const &tables,
+    Observer &observer
+    )
+{
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    langevin_walker_of<Precision> walker;
+    walker.position = conf.positionStart;
+
+    if (Observer::observeSamples) {
+        observer.onSample(0, 0, walker.position);
+    }
+
+    // Run in chunks so progress and stop checks stay out of the step loop
+    unsigned long long progress = conf.steps/20 > 0 ? conf.steps/20 : 1;
+    unsigned long long block = conf.blockSteps > 0 ? conf.blockSteps : conf.steps;
+    unsigned long long done = 0;
+    while (done < conf.steps) {
+        unsigned long long last = (done/progress + 1)*progress;
+        if ((done/block + 1)*block < last) {
+            last = (done/block + 1)*block;
+        }
+        if (last > conf.steps) {
+            last = conf.steps;
+        }
+        advanceLangevinWalker(tables, walker, 0, done+1, last,
+                              conf.saveFreq, observer);
+        done = last;
+        if (Observer::observeProgress && done % progress == 0) {
+            observer.onProgress(done, conf.steps);
+        }
+        if (conf.wallClockLimit > 0.0 && done % block == 0
+            && langevinElapsed(start) >= conf.wallClockLimit) {
+            break;
+        }
+    }
+    return done;
+}
+
+/* Builds the tables of a policy and runs a recorded trajectory on them */
+template <class Observer>
+struct langevin_trajectory_runner {
+    langevin_configuration const &conf;
+    langevin_output &out;
+    Observer &observer;
+
+    template <class Precision>
+    int run()
+    {
+        langevin_tables_of<typename Precision::table_type> tables;
+        buildLangevinTables(conf, tables);
+
+        langevin_trajectory_recorder recorder(out);
+        langevin_observer_pair<langevin_trajectory_recorder, Observer>
+            both(recorder, observer);
+        runLangevinTrajectory<Precision>(conf, tables, both);
+        return SPBD_SUCCESS;
+    }
+};
+
+/**
+ * @brief   Computes a single Langevin trajectory into out
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   conf        Simulation configuration
+ * @param   out         Output, samples are appended
+ * @param   observer    Additional observer
+ * @returns SPBD_SUCCESS or one of the SPBD_ERROR codes
+ */
+template <class Observer>
+inline int simulateLangevinTrajectory(
+    langevin_configuration const &conf,
+    langevin_output &out,
+    Observer &observer
+    )
+{
+    int status = validateLangevinConfiguration(conf);
+    if (status != SPBD_SUCCESS) {
+        return status;
+    }
+
+    langevin_trajectory_runner<Observer> runner = {conf, out, observer};
+    return dispatchLangevinPrecision(conf.precision, runner);
+}
+
+inline int simulateLangevinTrajectory(
+    langevin_configuration const &conf,
+    langevin_output &out
+    )
+{
+    langevin_observer none;
+    return simulateLangevinTrajectory(conf, out, none);
+}
+
+/**
+ * @brief   Accumulates the position histogram and first passages of walkers
+ * @ingroup Library
+ * @author  Kherim Willems
+ *
+ * A first passage is the first step at which a walker ends up on the other
+ * side of conf.eventPosition than where it started. Samples after the
+ * equilibration are counted per block over all walkers first; endBlock()
+ * adds the block to ensemble, and its squares only if it is a batch.
+ */
+template <class Table>
+struct langevin_ensemble_recorder : langevin_observer {
+    static const bool observeSteps = true;
+    static const bool observeSamples = true;
+
+    langevin_tables_of<Table> const &tables;
+    langevin_ensemble_output &ensemble;
+    float eventPosition;
+    bool startBelow;
+    bool passed;
+    unsigned long long equilibrationSteps;
+    unsigned long long batchCount;
+    std::vector<unsigned long long> batch;
+    std::vector<unsigned long> touched;
+
+    langevin_ensemble_recorder(
+        langevin_configuration const &conf,
+        langevin_tables_of<Table> const &tables,
+        langevin_ensemble_output &ensemble)
+        : tables(tables), ensemble(ensemble),
+          eventPosition(conf.eventPosition),
+          startBelow(conf.positionStart < conf.eventPosition),
+          passed(true), equilibrationSteps(conf.equilibrationSteps),
+          batchCount(0), batch(tables.bins(), 0)
+    {
+    }
+
+    /* Restores the passage state of the next walker */
+    void startWalker(bool walkerPassed)
+    {
+        passed = walkerPassed;
+    }
+
+    /* Adds the samples of all walkers in the block, as a batch if counted */
+    void endBlock(bool counted)
+    {
+        for (unsigned long i = 0; i < touched.size(); i++) {
+            unsigned long long count = batch[touched[i]];
+            ensemble.histogram[touched[i]] += count;
+            if (counted) {
+                ensemble.histogramSquares[touched[i]] += count*count;
+            }
+            batch[touched[i]] = 0;
+        }
+        touched.clear();
+        if (counted) {
+            ensemble.batches++;
+            ensemble.batchSamples += batchCount;
+        }
+        batchCount = 0;
+    }
+
+    template <class Position>
+    void onStep(unsigned long long, unsigned long long step, Position pos)
+    {
+        if (!passed && ((pos < eventPosition) != startBelow)) {
+            passed = true;
+            ensemble.events++;
+            ensemble.eventSteps += step;
+            ensemble.eventStepSquares += (double)step*(double)step;
+        }
+    }
+
+    template <class Position>
+    void onSample(unsigned long long, unsigned long long step, Position pos)
+    {
+        if (step <= equilibrationSteps) {
+            return;
+        }
+        unsigned long i = langevinIndex(tables, pos);
+        if (batch[i]++ == 0) {
+            touched.push_back(i);
+        }
+        batchCount++;
+        ensemble.samples++;
+    }
+};
+
+/**
+ * @brief   Clears an ensemble output and sizes its histograms
+ * @ingroup Library
+ * @author  Kherim Willems
+ */
+inline void resetLangevinEnsemble(
+    langevin_ensemble_output &ensemble,
+    unsigned long bins
+    )
+{
+    ensemble = langevin_ensemble_output();
+    ensemble.histogram.assign(bins, 0);
+    ensemble.histogramSquares.assign(bins, 0);
+}
+
+/**
+ * @brief   Adds the counts of one ensemble output to another
+ * @ingroup Library
+ * @author  Kherim Willems
+ */
+inline void addLangevinEnsemble(
+    langevin_ensemble_output &total,
+    langevin_ensemble_output const &part
+    )
+{
+    for (unsigned long i = 0; i < part.histogram.size(); i++) {
+        total.histogram[i] += part.histogram[i];
+        total.histogramSquares[i] += part.histogramSquares[i];
+    }
+    total.samples += part.samples;
+    total.batches += part.batches;
+    total.batchSamples += part.batchSamples;
+    total.walkerSteps += part.walkerSteps;
+    total.events += part.events;
+    total.eventSteps += part.eventSteps;
+    total.eventStepSquares += part.eventStepSquares;
+}
+
+/**
+ * @brief   Standard error of one histogram bin from the batch statistics
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @returns Error on ensemble.histogram[bin] in counts
+ *
+ * The variance is taken over successive batches, the full blocks after
+ * the equilibration, so a drift of the histogram from block to block,
+ * as while the walkers still relax from positionStart, shows up in the
+ * error. The mean bin count of a batch is the bin's share of all samples
+ * scaled to batchSamples, and the error is scaled back up to all samples,
+ * which includes those of blocks that are not batches.
+ */
+inline double langevinHistogramError(
+    langevin_ensemble_output const &ensemble,
+    unsigned long bin
+    )
+{
+    double n = ensemble.batches;
+    if (n < 2 || ensemble.batchSamples == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double scale = (double)ensemble.batchSamples/ensemble.samples;
+    double mean = ensemble.histogram[bin]*scale/n;
+    double variance = ensemble.histogramSquares[bin]/n - mean*mean;
+    if (variance < 0.0) {
+        variance = 0.0;
+    }
+    return n*std::sqrt(variance/(n-1))/scale;
+}
+
+/**
+ * @brief   Relative error of the whole histogram
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @returns Sum of the bin errors over the sum of the bin counts
+ */
+inline double langevinHistogramRelativeError(
+    langevin_ensemble_output const &ensemble
+    )
+{
+    if (ensemble.batches < 2 || ensemble.samples == 0) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double error = 0.0;
+    for (unsigned long i = 0; i < ensemble.histogram.size(); i++) {
+        if (ensemble.histogram[i] > 0) {
+            error += langevinHistogramError(ensemble, i);
+        }
+    }
+    return error/ensemble.samples;
+}
+
+/**
+ * @brief   Walkers that had not passed the event position when a run ended
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   walkers     Number of walkers in the ensemble
+ * @param   ensemble    Results of the run
+ *
+ * The mean first-passage step (eventSteps/events) only averages the
+ * walkers that passed. These censored walkers would all have passed later
+ * than the run lasted, so whenever there are any, in particular after a
+ * stop on targetEvents, the mean is biased low. It is then a lower bound.
+ */
+inline unsigned long long langevinCensoredWalkers(
+    unsigned long long walkers,
+    langevin_ensemble_output const &ensemble
+    )
+{
+    return walkers > ensemble.events ? walkers - ensemble.events : 0;
+}
+
+/**
+ * @brief   Standard error of the mean first-passage step
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @returns Error in steps, infinity with fewer than two events
+ *
+ * Only the statistical error over the passed walkers, not the bias from
+ * censored walkers (see langevinCensoredWalkers).
+ */
+inline double langevinPassageError(
+    langevin_ensemble_output const &ensemble
+    )
+{
+    double n = ensemble.events;
+    if (n < 2) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double mean = ensemble.eventSteps/n;
+    double variance = ensemble.eventStepSquares/n - mean*mean;
+    if (variance < 0.0) {
+        variance = 0.0;
+    }
+    return std::sqrt(variance/(n-1));
+}
+
+/**
+ * @brief   Evaluates the stopping criteria of a configuration
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   conf        Simulation configuration
+ * @param   total       Results collected so far
+ * @param   elapsed     Seconds since the run started
+ * @returns SPBD_RUNNING or the SPBD_STOP reason that was met
+ *
+ * The histogram error is only trusted from SPBD_MIN_BLOCKS batches on,
+ * that is full blocks of every walker after conf.equilibrationSteps, no
+ * matter how many walkers there are. A drift slower than the run so far,
+ * such as a rare escape from the start basin, does not show up in the
+ * error; set equilibrationSteps past it.
+ */
+inline int checkLangevinConvergence(
+    langevin_configuration const &conf,
+    langevin_ensemble_output const &total,
+    double elapsed
+    )
+{
+    if (conf.wallClockLimit > 0.0 && elapsed >= conf.wallClockLimit) {
+        return SPBD_STOP_WALLCLOCK;
+    }
+    if (conf.targetEvents > 0 && total.events >= conf.targetEvents) {
+        return SPBD_STOP_EVENTS;
+    }
+    if (conf.targetRelativeError > 0.0 && total.batches >= SPBD_MIN_BLOCKS
+        && langevinHistogramRelativeError(total) <= conf.targetRelativeError) {
+        return SPBD_STOP_CONVERGED;
+    }
+    return SPBD_RUNNING;
+}
+
+/**
+ * @brief   Describes a reason for a run to end
+ * @ingroup Library
+ * @author  Kherim Willems
+ */
+inline const char *langevinStopString(
+    int reason
+    )
+{
+    switch (reason) {
+    case SPBD_RUNNING:        return "running";
+    case SPBD_STOP_STEPS:     return "all steps done";
+    case SPBD_STOP_CONVERGED: return "histogram converged";
+    case SPBD_STOP_EVENTS:    return "event target reached";
+    case SPBD_STOP_WALLCLOCK: return "wall-clock budget used";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief   Block control for an ensemble computed in a single thread
+ * @ingroup Library
+ * @author  Kherim Willems
+ *
+ * Controls receive every finished block through onBlock() and return
+ * SPBD_RUNNING to continue or a stop reason to end the run.
+ */
+struct langevin_ensemble_accumulator {
+    langevin_configuration const &conf;
+    langevin_ensemble_output &total;
+    std::chrono::steady_clock::time_point start;
+
+    langevin_ensemble_accumulator(
+        langevin_configuration const &conf,
+        langevin_ensemble_output &total)
+        : conf(conf), total(total), start(std::chrono::steady_clock::now()) {}
+
+    int onBlock(unsigned long long, langevin_ensemble_output const &block)
+    {
+        addLangevinEnsemble(total, block);
+        return checkLangevinConvergence(conf, total, langevinElapsed(start));
+    }
+};
+
+/**
+ * @brief   Computes the walkers [firstWalker, lastWalker) of an ensemble
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   conf            Simulation configuration
+ * @param   tables          Step size tables built from conf
+ * @param   firstWalker     Index of the first walker to compute
+ * @param   lastWalker      Index one past the last walker to compute
+ * @param   control         Receives every block, decides when to stop
+ * @returns The SPBD_STOP reason the run ended with
+ *
+ * All walkers advance conf.blockSteps steps per block (all conf.steps if
+ * unset). A block is a batch of the error estimate if it has the full
+ * length and starts after conf.equilibrationSteps. Every walker draws from its own random stream, seeded from
+ * conf.seed and the walker index, so any split of the walkers gives the
+ * same blocks.
+ */
+template <class Precision = langevin_precision_float, class Control>
+inline int runLangevinEnsemble(
+    langevin_configuration const &conf,
+    langevin_tables_of<typename Precision::table_type> const &tables,
+    const unsigned long long firstWalker,
+    const unsigned long long lastWalker,
+    Control &control
+    )
+{
+    typedef typename Precision::table_type table_type;
+
+    std::vector<langevin_walker_of<Precision> > walkers(lastWalker - firstWalker);
+    std::vector<char> passed(walkers.size(), std::isnan(conf.eventPosition));
+    for (unsigned long long w = 0; w < walkers.size(); w++) {
+        seedLangevinWalker(walkers[w], conf.positionStart, conf.seed,
+                           firstWalker + w);
+    }
+
+    langevin_ensemble_output block;
+    resetLangevinEnsemble(block, tables.bins());
+    langevin_ensemble_recorder<table_type> recorder(conf, tables, block);
+
+    unsigned long long blockSteps =
+        conf.blockSteps > 0 ? conf.blockSteps : conf.steps;
+    if (blockSteps > conf.steps) {
+        blockSteps = conf.steps;
+    }
+    unsigned long long done = 0;
+    unsigned long long index = 0;
+    int reason = SPBD_STOP_STEPS;
+
+    while (done < conf.steps) {
+        unsigned long long last = done + blockSteps < conf.steps ?
+            done + blockSteps : conf.steps;
+        bool counted = last - done == blockSteps
+            && done >= conf.equilibrationSteps;
+        for (unsigned long long w = 0; w < walkers.size(); w++) {
+            recorder.startWalker(passed[w]);
+            advanceLangevinWalker(tables, walkers[w], firstWalker + w,
+                                  done+1, last, conf.saveFreq, recorder);
+            passed[w] = recorder.passed;
+        }
+        recorder.endBlock(counted);
+        block.walkerSteps = walkers.size()*(last - done);
+        done = last;
+
+        int status = control.onBlock(index++, block);
+        resetLangevinEnsemble(block, tables.bins());
+        if (status != SPBD_RUNNING) {
+            reason = status;
+            break;
+        }
+    }
+    return reason;
+}
+
+/* Builds the tables of a policy and runs an ensemble on them */
+struct langevin_ensemble_runner {
+    langevin_configuration const &conf;
+    langevin_ensemble_output &ensemble;
+
+    template <class Precision>
+    int run()
+    {
+        langevin_tables_of<typename Precision::table_type> tables;
+        buildLangevinTables(conf, tables);
+
+        resetLangevinEnsemble(ensemble, tables.bins());
+        langevin_ensemble_accumulator control(conf, ensemble);
+        ensemble.stopReason = runLangevinEnsemble<Precision>(
+            conf, tables, 0, conf.walkers, control);
+        return SPBD_SUCCESS;
+    }
+};
+
+/**
+ * @brief   Computes an ensemble of conf.walkers walkers in this thread
+ * @ingroup Library
+ * @author  Kherim Willems
+ * @param   conf        Simulation configuration
+ * @param   ensemble    Output, overwritten
+ * @returns SPBD_SUCCESS or one of the SPBD_ERROR codes
+ */
+inline int simulateLangevinEnsemble(
+    langevin_configuration const &conf,
+    langevin_ensemble_output &ensemble
+    )
+{
+    int status = validateLangevinConfiguration(conf);
+    if (status != SPBD_SUCCESS) {
+        return status;
+    }
+
+    langevin_ensemble_runner runner = {conf, ensemble};
+    return dispatchLangevinPrecision(conf.precision, runner);
+}
+
+#endif
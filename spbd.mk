@@ -28,6 +28,9 @@ LibraryPathSwitch      :=-L
 PreprocessorSwitch     :=-D
 SourceSwitch           :=-c 
 OutputFile             :=$(IntermediateDirectory)/$(ProjectName)
+ClientOutputFile       :=$(IntermediateDirectory)/$(ProjectName)-client
+TestOutputFile         :=$(IntermediateDirectory)/$(ProjectName)-regression
+BenchOutputFiles       :=$(IntermediateDirectory)/$(ProjectName)-bench-precision $(IntermediateDirectory)/$(ProjectName)-bench-tables
 Preprocessors          :=
 ObjectSwitch           :=-o 
 ArchiveOutputSwitch    := 
@@ -35,11 +38,11 @@ PreprocessOnlySwitch   :=-E
 ObjectsFileList        :="spbd.txt"
 PCHCompileFlags        :=
 MakeDirCommand         :=mkdir -p
-LinkOptions            :=  
+LinkOptions            :=  -pthread
 IncludePath            :=  $(IncludeSwitch). $(IncludeSwitch). 
 IncludePCH             := 
 RcIncludePath          := 
-Libs                   := 
+Libs                   := $(LibrarySwitch)rt 
 ArLibs                 :=  
 LibPath                := $(LibraryPathSwitch). 
 
@@ -50,7 +53,7 @@ LibPath                := $(LibraryPathSwitch).
 AR       := /usr/bin/ar rcu
 CXX      := /usr/bin/g++
 CC       := /usr/bin/gcc
-CXXFLAGS :=  -g -O2 -Wall -std=c++11 $(Preprocessors)
+CXXFLAGS :=  -g -O2 -Wall -std=c++11 -pthread $(Preprocessors)
 CFLAGS   :=  -g -O2 -Wall -std=c++11 $(Preprocessors)
 ASFLAGS  := 
 AS       := /usr/bin/as
@@ -60,17 +63,19 @@ AS       := /usr/bin/as
 ## User defined environment variables
 ##
 CodeLiteDir:=/usr/share/codelite
-Objects0=$(IntermediateDirectory)/fileio.cpp$(ObjectSuffix) $(IntermediateDirectory)/langevin.cpp$(ObjectSuffix) $(IntermediateDirectory)/main.cpp$(ObjectSuffix) 
+Objects0=$(IntermediateDirectory)/fileio.cpp$(ObjectSuffix) $(IntermediateDirectory)/langevin.cpp$(ObjectSuffix) $(IntermediateDirectory)/main.cpp$(ObjectSuffix) $(IntermediateDirectory)/ensemble.cpp$(ObjectSuffix) $(IntermediateDirectory)/pipeline.cpp$(ObjectSuffix) $(IntermediateDirectory)/server.cpp$(ObjectSuffix) 
 
 
 
 Objects=$(Objects0) 
 
+TestObjects=$(filter-out $(IntermediateDirectory)/main.cpp$(ObjectSuffix),$(Objects0)) $(IntermediateDirectory)/test_regression.cpp$(ObjectSuffix) 
+
 ##
 ## Main Build Targets 
 ##
-.PHONY: all clean PreBuild PrePreBuild PostBuild MakeIntermediateDirs
-all: $(OutputFile)
+.PHONY: all bench test test-baseline test-reference clean PreBuild PrePreBuild PostBuild MakeIntermediateDirs
+all: $(OutputFile) $(ClientOutputFile)
 
 $(OutputFile): $(IntermediateDirectory)/.d $(Objects) 
 	@$(MakeDirCommand) $(@D)
@@ -78,6 +83,35 @@ $(OutputFile): $(IntermediateDirectory)/.d $(Objects)
 	@echo $(Objects0)  > $(ObjectsFileList)
 	$(LinkerName) $(OutputSwitch)$(OutputFile) @$(ObjectsFileList) $(LibPath) $(Libs) $(LinkOptions)
 
+$(ClientOutputFile): $(IntermediateDirectory)/.d $(IntermediateDirectory)/client.cpp$(ObjectSuffix)
+	@$(MakeDirCommand) $(@D)
+	$(LinkerName) $(OutputSwitch)$(ClientOutputFile) $(IntermediateDirectory)/client.cpp$(ObjectSuffix) $(LibPath) $(Libs) $(LinkOptions)
+
+##
+## Regression tests, run from the project directory
+##
+test: $(TestOutputFile)
+	$(TestOutputFile) test/test_conf.txt test/baseline.txt test/reference.txt
+
+test-baseline: $(TestOutputFile)
+	$(TestOutputFile) --update-baseline test/test_conf.txt test/baseline.txt test/reference.txt
+
+test-reference: $(TestOutputFile)
+	$(TestOutputFile) --update-reference test/test_conf.txt test/baseline.txt test/reference.txt
+
+$(TestOutputFile): $(IntermediateDirectory)/.d $(TestObjects)
+	@$(MakeDirCommand) $(@D)
+	$(LinkerName) $(OutputSwitch)$(TestOutputFile) $(TestObjects) $(LibPath) $(Libs) $(LinkOptions)
+
+##
+## Benchmarks, built on request only
+##
+bench: $(BenchOutputFiles)
+
+$(IntermediateDirectory)/$(ProjectName)-bench-%: bench/%.cpp spbd.h
+	@$(MakeDirCommand) $(@D)
+	$(CXX) $(CXXFLAGS) $(IncludePath) $< $(OutputSwitch)$@ $(LibPath) $(Libs) $(LinkOptions)
+
 MakeIntermediateDirs:
 	@test -d ./Debug || $(MakeDirCommand) ./Debug
 
@@ -92,7 +126,7 @@ PreBuild:
 ## Objects
 ##
 $(IntermediateDirectory)/fileio.cpp$(ObjectSuffix): fileio.cpp $(IntermediateDirectory)/fileio.cpp$(DependSuffix)
-	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/willemsk/googledrive/git_projects/spbd/fileio.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/fileio.cpp$(ObjectSuffix) $(IncludePath)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "$<" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/fileio.cpp$(ObjectSuffix) $(IncludePath)
 $(IntermediateDirectory)/fileio.cpp$(DependSuffix): fileio.cpp
 	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/fileio.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/fileio.cpp$(DependSuffix) -MM fileio.cpp
 
@@ -100,7 +134,7 @@ $(IntermediateDirectory)/fileio.cpp$(PreprocessSuffix): fileio.cpp
 	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/fileio.cpp$(PreprocessSuffix) fileio.cpp
 
 $(IntermediateDirectory)/langevin.cpp$(ObjectSuffix): langevin.cpp $(IntermediateDirectory)/langevin.cpp$(DependSuffix)
-	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/willemsk/googledrive/git_projects/spbd/langevin.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/langevin.cpp$(ObjectSuffix) $(IncludePath)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "$<" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/langevin.cpp$(ObjectSuffix) $(IncludePath)
 $(IntermediateDirectory)/langevin.cpp$(DependSuffix): langevin.cpp
 	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/langevin.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/langevin.cpp$(DependSuffix) -MM langevin.cpp
 
@@ -108,7 +142,7 @@ $(IntermediateDirectory)/langevin.cpp$(PreprocessSuffix): langevin.cpp
 	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/langevin.cpp$(PreprocessSuffix) langevin.cpp
 
 $(IntermediateDirectory)/main.cpp$(ObjectSuffix): main.cpp $(IntermediateDirectory)/main.cpp$(DependSuffix)
-	$(CXX) $(IncludePCH) $(SourceSwitch) "/home/willemsk/googledrive/git_projects/spbd/main.cpp" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/main.cpp$(ObjectSuffix) $(IncludePath)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "$<" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/main.cpp$(ObjectSuffix) $(IncludePath)
 $(IntermediateDirectory)/main.cpp$(DependSuffix): main.cpp
 	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/main.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/main.cpp$(DependSuffix) -MM main.cpp
 
@@ -116,6 +150,46 @@ $(IntermediateDirectory)/main.cpp$(PreprocessSuffix): main.cpp
 	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/main.cpp$(PreprocessSuffix) main.cpp
 
 
+$(IntermediateDirectory)/ensemble.cpp$(ObjectSuffix): ensemble.cpp $(IntermediateDirectory)/ensemble.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "$<" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/ensemble.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/ensemble.cpp$(DependSuffix): ensemble.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/ensemble.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/ensemble.cpp$(DependSuffix) -MM ensemble.cpp
+
+$(IntermediateDirectory)/ensemble.cpp$(PreprocessSuffix): ensemble.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/ensemble.cpp$(PreprocessSuffix) ensemble.cpp
+
+$(IntermediateDirectory)/pipeline.cpp$(ObjectSuffix): pipeline.cpp $(IntermediateDirectory)/pipeline.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "$<" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/pipeline.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/pipeline.cpp$(DependSuffix): pipeline.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/pipeline.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/pipeline.cpp$(DependSuffix) -MM pipeline.cpp
+
+$(IntermediateDirectory)/pipeline.cpp$(PreprocessSuffix): pipeline.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/pipeline.cpp$(PreprocessSuffix) pipeline.cpp
+
+$(IntermediateDirectory)/server.cpp$(ObjectSuffix): server.cpp $(IntermediateDirectory)/server.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "$<" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/server.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/server.cpp$(DependSuffix): server.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/server.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/server.cpp$(DependSuffix) -MM server.cpp
+
+$(IntermediateDirectory)/server.cpp$(PreprocessSuffix): server.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/server.cpp$(PreprocessSuffix) server.cpp
+
+$(IntermediateDirectory)/client.cpp$(ObjectSuffix): client.cpp $(IntermediateDirectory)/client.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "$<" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/client.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/client.cpp$(DependSuffix): client.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/client.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/client.cpp$(DependSuffix) -MM client.cpp
+
+$(IntermediateDirectory)/client.cpp$(PreprocessSuffix): client.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/client.cpp$(PreprocessSuffix) client.cpp
+
+$(IntermediateDirectory)/test_regression.cpp$(ObjectSuffix): test/regression.cpp $(IntermediateDirectory)/test_regression.cpp$(DependSuffix)
+	$(CXX) $(IncludePCH) $(SourceSwitch) "$<" $(CXXFLAGS) $(ObjectSwitch)$(IntermediateDirectory)/test_regression.cpp$(ObjectSuffix) $(IncludePath)
+$(IntermediateDirectory)/test_regression.cpp$(DependSuffix): test/regression.cpp
+	@$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) -MG -MP -MT$(IntermediateDirectory)/test_regression.cpp$(ObjectSuffix) -MF$(IntermediateDirectory)/test_regression.cpp$(DependSuffix) -MM test/regression.cpp
+
+$(IntermediateDirectory)/test_regression.cpp$(PreprocessSuffix): test/regression.cpp
+	$(CXX) $(CXXFLAGS) $(IncludePCH) $(IncludePath) $(PreprocessOnlySwitch) $(OutputSwitch) $(IntermediateDirectory)/test_regression.cpp$(PreprocessSuffix) test/regression.cpp
+
 -include $(IntermediateDirectory)/*$(DependSuffix)
 ##
 ## Clean
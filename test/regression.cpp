@@ -0,0 +1,769 @@
+/**
+ * @defgroup  Tests  Regression tests
+ * @brief     Reproducibility, statistics and throughput checks
+*/
+/**
+ * @file    regression.cpp
+ * @ingroup Tests
+ * @brief   Regression harness run by "make -f spbd.mk test"
+ * @version $spbd_version$
+ * @author  Kherim Willems
+ *
+ * Runs shortened, fixed-seed versions of a reference configuration
+ * (test/test_conf.txt by default) and checks:
+ *
+ *  - bit-exact agreement where it is promised: the library, console,
+ *    pipeline and server paths give the same trajectory; ensembles give
+ *    the same results for any number of processes, on the server, and
+ *    (histogram and events) for any block size, also when a stopping
+ *    criterion ends the run early. Every precision policy is checked;
+ *  - the fixed-seed trajectory and ensemble of every policy against the
+ *    hashes stored in test/reference.txt, so that a change that moves all
+ *    paths at once is caught too. The hashes hold for one standard
+ *    library: std::normal_distribution is not specified bit for bit, so
+ *    they are refreshed with --update-reference when moving to another;
+ *  - that a malformed server job is answered with an error, and that a
+ *    full table cache evicts its oldest entry;
+ *  - agreement of the sampled distribution with the Boltzmann
+ *    distribution of the forceVector potential in the starting basin,
+ *    also for an ensemble stopped on targetRelativeError, which must not
+ *    stop before SPBD_MIN_BLOCKS blocks after its equilibration;
+ *  - steps/s of the float trajectory against test/baseline.txt, skipped
+ *    when SPBD_SKIP_ABSOLUTE_THROUGHPUT is set since they depend on the
+ *    machine, and the throughput of every other path relative to the
+ *    float trajectory of the same run against the stored ratios.
+ *
+ * Usage: spbd-regression [--update-baseline] [--update-reference]
+ *                        [conf file] [baseline file] [reference file]
+ *
+ * @attention
+ * @verbatim
+ *
+ * SPBD -- Single Protein Brownian Dynamics
+ *
+ *  Kherim Willems (kherim@kher.im)
+ *
+ * @endverbatim
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "langevin.h"
+#include "ensemble.h"
+#include "fileio.h"
+#include "pipeline.h"
+#include "server.h"
+
+/* Reference runs */
+#define REGRESSION_STEPS        200000
+#define REGRESSION_SAVE_FREQ    100
+#define REGRESSION_SEED         1
+#define REGRESSION_WALKERS      8
+#define REGRESSION_PROCESSES    3
+#define REGRESSION_BLOCK_STEPS  20000
+
+/* Stop on events, with short blocks so the stop falls mid-run and enough
+   walkers for the processes to interleave */
+#define REGRESSION_STOP_WALKERS         200
+#define REGRESSION_STOP_BLOCK_STEPS     500
+#define REGRESSION_STOP_EVENT_SPACINGS  50
+
+/* Boltzmann check, with a timestep small enough for Euler-Maruyama bias
+   to stay well below the tolerance on the Kolmogorov-Smirnov distance */
+#define REGRESSION_BOLTZMANN_TIMESTEP   0.01
+#define REGRESSION_BOLTZMANN_SAVE_FREQ  10
+#define REGRESSION_BOLTZMANN_TOLERANCE  0.01
+
+/* Early stop check: many walkers with short blocks and a loose target */
+#define REGRESSION_CONVERGENCE_WALKERS          2000
+#define REGRESSION_CONVERGENCE_BLOCK_STEPS      200
+#define REGRESSION_CONVERGENCE_EQUILIBRATION    2000
+#define REGRESSION_CONVERGENCE_TARGET           0.1
+
+/* Throughput check */
+#define REGRESSION_BENCH_STEPS  20000000
+#define REGRESSION_BENCH_RUNS   5
+/* Set on machines other than the one that measured the baseline */
+#define REGRESSION_SKIP_ABSOLUTE    "SPBD_SKIP_ABSOLUTE_THROUGHPUT"
+#define REGRESSION_TOLERANCE    0.25
+
+/* Swallows everything written to std::cout while it lives */
+struct quiet_console {
+    std::ostringstream sink;
+    std::streambuf *saved;
+
+    quiet_console() : saved(std::cout.rdbuf(sink.rdbuf())) {}
+    ~quiet_console() { std::cout.rdbuf(saved); }
+};
+
+static int failures = 0;
+
+static void check(
+    bool passed,
+    std::string const &name
+    )
+{
+    std::cout << (passed ? "  [ok]   " : "  [FAIL] ") << name << "\n"
+              << std::flush;
+    if (!passed) {
+        failures++;
+    }
+}
+
+template <class T>
+static bool sameBits(
+    std::vector<T> const &a,
+    std::vector<T> const &b
+    )
+{
+    return a.size() == b.size()
+        && (a.empty() || std::memcmp(a.data(), b.data(), a.size()*sizeof(T)) == 0);
+}
+
+static bool sameEnsemble(
+    langevin_ensemble_output const &a,
+    langevin_ensemble_output const &b,
+    bool squares
+    )
+{
+    return sameBits(a.histogram, b.histogram)
+        && (!squares || sameBits(a.histogramSquares, b.histogramSquares))
+        && a.samples == b.samples
+        && a.walkerSteps == b.walkerSteps
+        && a.events == b.events
+        && a.eventSteps == b.eventSteps
+        && std::memcmp(&a.eventStepSquares, &b.eventStepSquares,
+                       sizeof(double)) == 0;
+}
+
+/* FNV-1a hashes of the fixed-seed results, by policy and path */
+static std::map<std::string, unsigned long long> results;
+
+static void hashBytes(
+    unsigned long long &hash,
+    const void *data,
+    size_t size
+    )
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+}
+
+template <typename T>
+static void hashVector(
+    unsigned long long &hash,
+    std::vector<T> const &v
+    )
+{
+    hashBytes(hash, v.data(), v.size()*sizeof(T));
+}
+
+static unsigned long long hashTrajectory(
+    langevin_output const &out
+    )
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    hashVector(hash, out.positionVector);
+    hashVector(hash, out.timeVector);
+    return hash;
+}
+
+static unsigned long long hashEnsemble(
+    langevin_ensemble_output const &ensemble
+    )
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    hashVector(hash, ensemble.histogram);
+    hashVector(hash, ensemble.histogramSquares);
+    unsigned long long counts[] = {
+        ensemble.samples, ensemble.batches, ensemble.batchSamples,
+        ensemble.walkerSteps, ensemble.events, ensemble.eventSteps
+    };
+    hashBytes(hash, counts, sizeof(counts));
+    hashBytes(hash, &ensemble.eventStepSquares, sizeof(double));
+    return hash;
+}
+
+static std::string readFile(
+    std::string const &filename
+    )
+{
+    std::ifstream infile(filename.c_str());
+    std::ostringstream contents;
+    contents << infile.rdbuf();
+    return contents.str();
+}
+
+/* The reference configuration with the shortened run settings */
+static int referenceConfiguration(
+    std::string const &confFile,
+    std::vector<std::string> &lines,
+    langevin_configuration &conf
+    )
+{
+    if (readFileToStrings(confFile, lines) != 0) {
+        return -1;
+    }
+    std::ostringstream overrides;
+    overrides << "steps " << REGRESSION_STEPS << "\n"
+              << "saveFreq " << REGRESSION_SAVE_FREQ << "\n"
+              << "seed " << REGRESSION_SEED << "\n"
+              << "trajectoryOutputFile none";
+    lines.push_back("");
+    std::string line;
+    std::istringstream stream(overrides.str());
+    while (std::getline(stream, line)) {
+        lines.push_back(line);
+    }
+
+    conf = langevin_configuration();
+    parseConfiguration(lines, conf);
+    return validateLangevinConfiguration(conf);
+}
+
+/* Library, console, pipeline and server trajectories of one policy */
+static void checkTrajectory(
+    std::vector<std::string> lines,
+    langevin_configuration conf,
+    langevin_table_cache &cache
+    )
+{
+    std::string name = langevinPrecisionString(conf.precision);
+    lines.push_back(std::string("precision ") + name);
+
+    langevin_output library;
+    simulateLangevinTrajectory(conf, library);
+    results[name + ".trajectory"] = hashTrajectory(library);
+
+    langevin_simulation console;
+    console.conf = conf;
+    {
+        quiet_console quiet;
+        computeLangevinTrajectory(console);
+    }
+    check(sameBits(library.positionVector, console.out.positionVector)
+          && sameBits(library.timeVector, console.out.timeVector),
+          name + ": console trajectory matches library");
+
+    const std::string classicFile = "regression_classic.trj";
+    const std::string pipelineFile = "regression_pipeline.trj";
+    int digits = langevinPositionDigits(conf.precision);
+    writeTrajectoryToFile(classicFile, library.positionVector,
+                          library.timeVector, digits);
+    langevin_simulation streamed;
+    streamed.conf = conf;
+    streamed.conf.pipelineStages.assign(1, "writer");
+    streamed.conf.pipelineBackpressure = true;
+    streamed.conf.trajectoryOutputFile = pipelineFile;
+    {
+        quiet_console quiet;
+        analysis_pipeline pipeline(streamed.conf.pipelineRingSize, true);
+        buildAnalysisPipeline(streamed.conf, pipeline);
+        pipeline.start();
+        computeLangevinPipeline(streamed, pipeline);
+    }
+    std::string classic = readFile(classicFile);
+    check(!classic.empty() && classic == readFile(pipelineFile),
+          name + ": pipeline writer matches classic trajectory file");
+    std::remove(classicFile.c_str());
+    std::remove(pipelineFile.c_str());
+
+    std::ostringstream body;
+    writeTrajectory(body, library.positionVector, library.timeVector, digits);
+    std::string first = runLangevinJob(cache, "t", lines);
+    std::string second = runLangevinJob(cache, "t", lines);
+    // Policies with the same table type share cached tables
+    std::string expected = body.str() + "end t\n";
+    check(first.substr(first.find('\n')+1) == expected
+          && second == "result t 0 cached\n" + expected,
+          name + ": server job matches library, also on cached tables");
+}
+
+/* Ensembles of one policy over process counts, block sizes and the server */
+static void checkEnsemble(
+    std::vector<std::string> lines,
+    langevin_configuration conf,
+    langevin_table_cache &cache
+    )
+{
+    std::string name = langevinPrecisionString(conf.precision);
+    conf.walkers = REGRESSION_WALKERS;
+    conf.blockSteps = REGRESSION_BLOCK_STEPS;
+    conf.eventPosition = conf.positionStart + 10*conf.positionSpacing;
+
+    langevin_simulation single;
+    single.conf = conf;
+    single.conf.processes = 1;
+    langevin_simulation shared;
+    shared.conf = conf;
+    shared.conf.processes = REGRESSION_PROCESSES;
+    langevin_simulation unblocked;
+    unblocked.conf = single.conf;
+    unblocked.conf.blockSteps = 0;
+    {
+        quiet_console quiet;
+        computeLangevinEnsemble(single);
+        computeLangevinEnsemble(shared);
+        computeLangevinEnsemble(unblocked);
+    }
+    check(single.ensemble.samples > 0
+          && sameEnsemble(single.ensemble, shared.ensemble, true),
+          name + ": ensemble identical on 1 and "
+          + std::to_string(REGRESSION_PROCESSES) + " processes");
+    check(sameEnsemble(single.ensemble, unblocked.ensemble, false),
+          name + ": histogram and events independent of blockSteps");
+    results[name + ".ensemble"] = hashEnsemble(single.ensemble);
+
+    langevin_simulation stopped;
+    stopped.conf = single.conf;
+    stopped.conf.walkers = REGRESSION_STOP_WALKERS;
+    stopped.conf.blockSteps = REGRESSION_STOP_BLOCK_STEPS;
+    stopped.conf.eventPosition = conf.positionStart
+        + REGRESSION_STOP_EVENT_SPACINGS*conf.positionSpacing;
+    stopped.conf.targetEvents = stopped.conf.walkers;
+    langevin_simulation stoppedShared;
+    stoppedShared.conf = stopped.conf;
+    stoppedShared.conf.processes = REGRESSION_PROCESSES;
+    {
+        quiet_console quiet;
+        computeLangevinEnsemble(stopped);
+        computeLangevinEnsemble(stoppedShared);
+    }
+    check(stopped.ensemble.stopReason == SPBD_STOP_EVENTS
+          && stoppedShared.ensemble.stopReason == SPBD_STOP_EVENTS
+          && stopped.ensemble.walkerSteps < stopped.conf.walkers*conf.steps
+          && sameEnsemble(stopped.ensemble, stoppedShared.ensemble, true),
+          name + ": event stop after the same block on 1 and "
+          + std::to_string(REGRESSION_PROCESSES) + " processes");
+
+    std::ostringstream job;
+    job << "walkers " << conf.walkers << "\n"
+        << "blockSteps " << conf.blockSteps << "\n"
+        << "eventPosition " << conf.eventPosition << "\n"
+        << "precision " << name;
+    std::string line;
+    std::istringstream stream(job.str());
+    while (std::getline(stream, line)) {
+        lines.push_back(line);
+    }
+    langevin_configuration parsed = langevin_configuration();
+    parseConfiguration(lines, parsed);
+    langevin_ensemble_output ensemble;
+    simulateLangevinEnsemble(parsed, ensemble);
+
+    std::ostringstream body;
+    writeEvents(body, parsed.timestep, parsed.walkers, ensemble);
+    writeHistogram(body, parsed.positionSpacing, ensemble);
+    std::string response = runLangevinJob(cache, "e", lines);
+    check(response.substr(response.find('\n')+1) == body.str() + "end e\n",
+          name + ": server ensemble matches library");
+}
+
+/* The hashes collected by the reproducibility checks against the stored ones */
+static void checkReference(
+    std::string const &referenceFile,
+    bool update
+    )
+{
+    if (update) {
+        std::ofstream outfile(referenceFile.c_str());
+        outfile << "# FNV-1a hashes of the fixed-seed regression runs, written"
+                << " by spbd-regression\n# --update-reference. They depend on"
+                << " the standard library's random\n# distributions and are"
+                << " refreshed when moving to another one.\n";
+        for (auto it = results.begin(); it != results.end(); ++it) {
+            outfile << it->first << " " << std::hex << std::setw(16)
+                    << std::setfill('0') << it->second << std::dec << "\n";
+        }
+        std::cout << "  Reference written to " << referenceFile << ".\n";
+        return;
+    }
+
+    std::map<std::string, unsigned long long> reference;
+    std::ifstream infile(referenceFile.c_str());
+    std::string key;
+    unsigned long long value;
+    while (infile >> key) {
+        if (key[0] == '#') {
+            std::getline(infile, key);
+            continue;
+        }
+        if (!(infile >> std::hex >> value >> std::dec)) {
+            break;
+        }
+        reference[key] = value;
+    }
+    if (reference.empty()) {
+        std::cout << "  No reference in " << referenceFile
+                  << ", run with --update-reference.\n";
+        return;
+    }
+    for (auto it = results.begin(); it != results.end(); ++it) {
+        check(reference.count(it->first) > 0
+              && reference[it->first] == it->second,
+              it->first + " matches " + referenceFile);
+    }
+}
+
+/* Server robustness: malformed jobs and a full table cache */
+static void checkServer(
+    std::vector<std::string> lines,
+    langevin_configuration conf
+    )
+{
+    langevin_table_cache cache(2);
+    lines.push_back("steps abc");
+    std::ostringstream error;
+    error << "result m " << SPBD_ERROR_PARSE << " none\nend m\n";
+    check(runLangevinJob(cache, "m", lines) == error.str(),
+          "server: malformed job answers with an error");
+
+    bool hit = false;
+    bool cached = true;
+    for (int i = 0; i < 3; i++) {
+        conf.temperature *= 2;
+        cache.get<float>(conf, hit);
+        cached = cached && !hit;
+    }
+    cache.get<float>(conf, hit);
+    cached = cached && hit && cache.size() == 2;
+    // A new entry evicts the tables for 4T, those for 8T stay
+    conf.temperature /= 8;
+    cache.get<float>(conf, hit);
+    cached = cached && !hit && cache.size() == 2;
+    conf.temperature *= 8;
+    cache.get<float>(conf, hit);
+    check(cached && hit, "server: table cache evicts its oldest entry");
+}
+
+/*
+ * Kolmogorov-Smirnov distance between the sampled histogram and the
+ * Boltzmann distribution, both restricted to the basin around the start.
+ * The engine uses force i on all of [x_i, x_i+1), so the potential is
+ * piecewise linear, U(x_i+1) = U(x_i) - F_i*dx, and bin i has weight
+ * exp(-U_i/kT)*kT/F_i*(exp(F_i*dx/kT) - 1).
+ */
+static double boltzmannDistance(
+    langevin_configuration const &conf,
+    langevin_ensemble_output const &ensemble
+    )
+{
+    const unsigned long bins = conf.forceVector.size();
+    const double dx = conf.positionSpacing;
+    const double kT = conf.temperature;
+
+    std::vector<double> potential(bins+1, 0.0);
+    for (unsigned long i = 0; i < bins; i++) {
+        potential[i+1] = potential[i] - conf.forceVector[i]*dx;
+    }
+
+    // Walk down into the well of the start, then up to the barriers
+    unsigned long lo = std::min((unsigned long)(conf.positionStart/dx), bins-1);
+    unsigned long hi = lo;
+    while (lo > 0 && potential[lo-1] <= potential[lo]) lo--;
+    while (lo > 0 && potential[lo-1] >= potential[lo]) lo--;
+    while (hi < bins && potential[hi+1] <= potential[hi]) hi++;
+    while (hi < bins && potential[hi+1] >= potential[hi]) hi++;
+
+    double minimum = potential[lo];
+    for (unsigned long i = lo; i < hi; i++) {
+        minimum = std::min(minimum, potential[i]);
+    }
+    std::vector<double> weight(bins, 0.0);
+    double weights = 0.0;
+    double counts = 0.0;
+    for (unsigned long i = lo; i < hi; i++) {
+        double force = conf.forceVector[i];
+        double width = std::fabs(force*dx/kT) > 1e-12 ?
+            kT/force*std::expm1(force*dx/kT) : dx;
+        weight[i] = std::exp(-(potential[i] - minimum)/kT)*width;
+        weights += weight[i];
+        counts += ensemble.histogram[i];
+    }
+    if (!(weights > 0.0) || counts == 0.0) {
+        return 1.0;
+    }
+
+    double expected = 0.0;
+    double sampled = 0.0;
+    double distance = 0.0;
+    for (unsigned long i = lo; i < hi; i++) {
+        expected += weight[i]/weights;
+        sampled += ensemble.histogram[i]/counts;
+        distance = std::max(distance, std::fabs(expected - sampled));
+    }
+    return distance;
+}
+
+static void checkBoltzmann(
+    langevin_configuration conf
+    )
+{
+    std::string name = langevinPrecisionString(conf.precision);
+    conf.timestep = REGRESSION_BOLTZMANN_TIMESTEP;
+    conf.saveFreq = REGRESSION_BOLTZMANN_SAVE_FREQ;
+    conf.walkers = REGRESSION_WALKERS;
+
+    langevin_ensemble_output ensemble;
+    simulateLangevinEnsemble(conf, ensemble);
+    double distance = boltzmannDistance(conf, ensemble);
+
+    std::ostringstream label;
+    label << name << ": Boltzmann distribution, KS distance "
+          << std::setprecision(2) << distance << " <= "
+          << REGRESSION_BOLTZMANN_TOLERANCE;
+    check(distance <= REGRESSION_BOLTZMANN_TOLERANCE, label.str());
+}
+
+/*
+ * A stop on targetRelativeError with many walkers and short blocks must
+ * wait for SPBD_MIN_BLOCKS blocks after the equilibration, and by then
+ * the start basin must be sampled as well as by the Boltzmann check.
+ */
+static void checkConvergence(
+    langevin_configuration conf
+    )
+{
+    std::string name = langevinPrecisionString(conf.precision);
+    conf.timestep = REGRESSION_BOLTZMANN_TIMESTEP;
+    conf.saveFreq = REGRESSION_BOLTZMANN_SAVE_FREQ;
+    conf.walkers = REGRESSION_CONVERGENCE_WALKERS;
+    conf.blockSteps = REGRESSION_CONVERGENCE_BLOCK_STEPS;
+    conf.equilibrationSteps = REGRESSION_CONVERGENCE_EQUILIBRATION;
+    conf.targetRelativeError = REGRESSION_CONVERGENCE_TARGET;
+
+    langevin_ensemble_output ensemble;
+    simulateLangevinEnsemble(conf, ensemble);
+    double distance = boltzmannDistance(conf, ensemble);
+    unsigned long long steps = ensemble.walkerSteps/conf.walkers;
+
+    std::ostringstream label;
+    label << name << ": converged after " << steps << " steps, KS distance "
+          << std::setprecision(2) << distance << " <= "
+          << REGRESSION_BOLTZMANN_TOLERANCE;
+    check(ensemble.stopReason == SPBD_STOP_CONVERGED
+          && steps >= conf.equilibrationSteps + SPBD_MIN_BLOCKS*conf.blockSteps
+          && distance <= REGRESSION_BOLTZMANN_TOLERANCE, label.str());
+}
+
+/* Walker steps per second of one trajectory with the tables of a policy */
+template <class Precision>
+static double trajectoryRate(
+    langevin_configuration const &conf
+    )
+{
+    langevin_tables_of<typename Precision::table_type> tables;
+    buildLangevinTables(conf, tables);
+    langevin_observer none;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    runLangevinTrajectory<Precision>(conf, tables, none);
+    return conf.steps/langevinElapsed(start);
+}
+
+/*
+ * Best walker steps per second of trajectories of every policy and of a
+ * float ensemble. The paths take turns, so a slow spell of the machine
+ * hits all of them rather than one.
+ */
+static void measureThroughput(
+    langevin_configuration conf,
+    std::map<std::string, double> &rates
+    )
+{
+    conf.steps = REGRESSION_BENCH_STEPS;
+    conf.saveFreq = conf.steps;
+    conf.walkers = REGRESSION_WALKERS;
+    conf.blockSteps = 0;
+    langevin_configuration ensembleConf = conf;
+    ensembleConf.steps /= conf.walkers;
+
+    rates.clear();
+    for (int run = 0; run < REGRESSION_BENCH_RUNS; run++) {
+        double measured[] = {
+            trajectoryRate<langevin_precision_float>(conf),
+            trajectoryRate<langevin_precision_mixed>(conf),
+            trajectoryRate<langevin_precision_compensated>(conf),
+            trajectoryRate<langevin_precision_double>(conf),
+            trajectoryRate<langevin_precision_compact>(conf),
+            0.0
+        };
+        langevin_ensemble_output output;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        simulateLangevinEnsemble(ensembleConf, output);
+        measured[5] = output.walkerSteps/langevinElapsed(start);
+
+        for (int p = SPBD_PRECISION_FLOAT; p <= SPBD_PRECISION_COMPACT; p++) {
+            double &best = rates[langevinPrecisionString(p)];
+            best = std::max(best, measured[p]);
+        }
+        double &best = rates["ensemble"];
+        best = std::max(best, measured[5]);
+    }
+}
+
+/*
+ * Steps/s of the float trajectory against the baseline, which catches a
+ * slowdown of every path at once, unless REGRESSION_SKIP_ABSOLUTE is set
+ * in the environment. The throughput of every other path relative to the
+ * float trajectory of the same run is checked against the stored ratios
+ * on any machine.
+ */
+static void checkThroughput(
+    langevin_configuration const &conf,
+    std::string const &baselineFile,
+    bool update
+    )
+{
+    std::map<std::string, double> rates;
+    measureThroughput(conf, rates);
+    const double reference = rates["float"];
+
+    double tolerance = REGRESSION_TOLERANCE;
+    std::map<std::string, double> baseline;
+    std::ifstream infile(baselineFile.c_str());
+    std::string key;
+    double value;
+    while (infile >> key) {
+        if (key[0] == '#') {
+            std::getline(infile, key);
+            continue;
+        }
+        if (!(infile >> value)) {
+            break;
+        }
+        if (key == "tolerance") {
+            tolerance = value;
+        } else {
+            baseline[key] = value;
+        }
+    }
+
+    if (update) {
+        std::ofstream outfile(baselineFile.c_str());
+        outfile << "# Steps/s of the float trajectory and the throughput of the"
+                << " other paths\n# relative to it, written by spbd-regression"
+                << " --update-baseline. The test\n# fails when a value drops"
+                << " more than tolerance below its baseline. The\n# steps/s"
+                << " hold for the machine that measured them, set "
+                << REGRESSION_SKIP_ABSOLUTE << "\n# to check only the"
+                << " ratios elsewhere.\n"
+                << "tolerance " << tolerance << "\n"
+                << std::setprecision(4)
+                << "floatStepsPerSecond " << reference << "\n";
+        for (auto it = rates.begin(); it != rates.end(); ++it) {
+            if (it->first != "float") {
+                outfile << it->first << "Ratio " << it->second/reference << "\n";
+            }
+        }
+        std::cout << "  Baseline written to " << baselineFile << ".\n";
+        return;
+    }
+
+    if (baseline.count("floatStepsPerSecond") == 0) {
+        std::cout << "  No floatStepsPerSecond in " << baselineFile
+                  << ", run with --update-baseline.\n";
+    } else if (std::getenv(REGRESSION_SKIP_ABSOLUTE) != NULL) {
+        std::cout << std::setprecision(3) << "  float trajectory " << reference
+                  << " steps/s, not checked against "
+                  << baseline["floatStepsPerSecond"] << " ("
+                  << REGRESSION_SKIP_ABSOLUTE << " is set)\n";
+    } else {
+        std::ostringstream label;
+        label << std::setprecision(3) << "float trajectory " << reference
+              << " steps/s, baseline " << baseline["floatStepsPerSecond"];
+        check(reference >= (1.0 - tolerance)*baseline["floatStepsPerSecond"],
+              label.str());
+    }
+    for (auto it = rates.begin(); it != rates.end(); ++it) {
+        if (it->first == "float") {
+            continue;
+        }
+        double ratio = it->second/reference;
+        std::string name = it->first + "Ratio";
+        if (baseline.count(name) == 0) {
+            std::cout << "  No " << name << " in " << baselineFile
+                      << ", run with --update-baseline.\n";
+            continue;
+        }
+        std::ostringstream label;
+        label << std::setprecision(3) << it->first << " at " << ratio
+              << " of float, baseline " << baseline[name];
+        check(ratio >= (1.0 - tolerance)*baseline[name], label.str());
+    }
+}
+
+int main(
+         int argc,
+         char **argv
+         )
+{
+    bool update = false;
+    bool updateReference = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--update-baseline") == 0) {
+            update = true;
+        } else if (std::strcmp(argv[i], "--update-reference") == 0) {
+            updateReference = true;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    std::string confFile = files.size() > 0 ? files[0] : "test/test_conf.txt";
+    std::string baselineFile = files.size() > 1 ? files[1] : "test/baseline.txt";
+    std::string referenceFile =
+        files.size() > 2 ? files[2] : "test/reference.txt";
+
+    std::vector<std::string> lines;
+    langevin_configuration conf;
+    if (referenceConfiguration(confFile, lines, conf) != SPBD_SUCCESS) {
+        std::cout << "Could not load " << confFile << ".\n";
+        return 1;
+    }
+
+    std::cout << "Regression tests on " << confFile << ", "
+              << conf.steps << " steps.\n";
+    langevin_table_cache cache;
+    std::cout << "Reproducibility:\n";
+    for (int p = SPBD_PRECISION_FLOAT; p <= SPBD_PRECISION_COMPACT; p++) {
+        conf.precision = p;
+        checkTrajectory(lines, conf, cache);
+        checkEnsemble(lines, conf, cache);
+    }
+    checkReference(referenceFile, updateReference);
+    conf.precision = SPBD_PRECISION_FLOAT;
+    checkServer(lines, conf);
+    std::cout << "Statistics:\n";
+    for (int p = SPBD_PRECISION_FLOAT; p <= SPBD_PRECISION_COMPACT; p++) {
+        conf.precision = p;
+        checkBoltzmann(conf);
+    }
+    conf.precision = SPBD_PRECISION_FLOAT;
+    checkConvergence(conf);
+    std::cout << "Throughput:\n";
+    conf.precision = SPBD_PRECISION_FLOAT;
+    checkThroughput(conf, baselineFile, update);
+
+    if (failures > 0) {
+        std::cout << failures << " checks failed.\n";
+        return 1;
+    }
+    std::cout << "All checks passed.\n";
+    return 0;
+}